@@ -104,7 +104,8 @@ extern int ezusb_load_ram (
  * type is set so that the microcontroller will boot from it.
  *
  * The caller must have preloaded a second stage loader that knows
- * how to respond to the EEPROM write request.
+ * how to respond to the EEPROM write request, unless the firmware
+ * running on the device does (like usb_jtag, see fxload -e).
  */
 extern int ezusb_load_eeprom (
     IOUSBDeviceInterface** dev, /* usb device handle */
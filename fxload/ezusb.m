@@ -366,7 +366,8 @@ int ezusb_load_ram (IOUSBDeviceInterface** dev, NSString* hexfilePath,
  * (Defaults:  FX2 0x08, FX 0x00, AN21xx n/a)
  *
  * Caller must have pre-loaded a second stage loader that knows how
- * to handle the EEPROM write requests.
+ * to handle the EEPROM write requests, unless the running firmware
+ * handles them itself (fxload -e).
  */
 int ezusb_load_eeprom (IOUSBDeviceInterface** dev, NSString* hexfilePath,     
     const part_type partType, uint8_t config)
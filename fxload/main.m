@@ -31,6 +31,7 @@ static NSString* const kArg2ndStage = @"kArg2ndStage";
 static NSString* const kArgConfigByte = @"kArgConfigByte";
 static NSString* const kArgVid = @"kArgVid";
 static NSString* const kArgPid = @"kArgPid";
+static NSString* const kArgRunning = @"kArgRunning";
 
 static void printUsage(char* argv0)
 {
@@ -38,8 +39,9 @@ static void printUsage(char* argv0)
     fputs(argv0, stderr);
     fputs(" [-vV] [-t type] [-D vid:pid]\n", stderr);
     fputs("\t\t[-I firmware_hexfile] ", stderr);
-    fputs("[-s loader] [-c config_byte]\n", stderr);
+    fputs("[-s loader | -e] [-c config_byte]\n", stderr);
     fputs("... device types:  one of an21, fx, fx2, fx2lp\n", stderr);
+    fputs("... -e: the running firmware handles the EEPROM requests\n", stderr);
 }
 
 static int findDevice(IOUSBDeviceInterface*** dev, NSNumber* vid, NSNumber* pid)
@@ -125,7 +127,7 @@ static NSDictionary* parseArgs(int argc, char* argv[], BOOL* result)
     
     *result = TRUE;
     
-    while((opt = getopt(argc, argv, "2vVhD:I:c:s:t:")) != EOF)
+    while((opt = getopt(argc, argv, "2evVhD:I:c:s:t:")) != EOF)
     {
         switch(opt)
         {
@@ -176,6 +178,12 @@ static NSDictionary* parseArgs(int argc, char* argv[], BOOL* result)
                 }
                 break;
             }
+            case 'e':
+            {
+                // firmware already running answers 0xA2/0xA5 (usb_jtag)
+                [args setValue:[NSNumber numberWithBool:YES] forKey:kArgRunning];
+                break;
+            }
             case 's':
             {
                 [args setValue:[NSString stringWithCString:optarg
@@ -236,9 +244,25 @@ static NSDictionary* parseArgs(int argc, char* argv[], BOOL* result)
             *result = FALSE;
         }
         
-        if([args valueForKey:kArg2ndStage] == nil && [args valueForKey:kArgHexFile] == nil)
+        if(([args valueForKey:kArg2ndStage] == nil && [args valueForKey:kArgRunning] == nil)
+           || [args valueForKey:kArgHexFile] == nil)
         {
-            NSLog(@"Need 2nd stage loader and firmware to write to EEPROM");
+            NSLog(@"Need 2nd stage loader (or -e) and firmware to write to EEPROM");
+            *result = FALSE;
+        }
+    }
+    
+    if([args valueForKey:kArgRunning] != nil)
+    {
+        if([args valueForKey:kArgConfigByte] == nil)
+        {
+            NSLog(@"-e only writes the EEPROM, must specify -c");
+            *result = FALSE;
+        }
+        
+        if([args valueForKey:kArg2ndStage] != nil)
+        {
+            NSLog(@"-e and -s are mutually exclusive");
             *result = FALSE;
         }
     }
@@ -317,7 +341,22 @@ int main (int argc, char * argv[]) {
         }
         
         NSString* stage2 = [args valueForKey:kArg2ndStage];
-        if(stage2 != nil)
+        if([args valueForKey:kArgRunning] != nil)
+        {
+            // no loader: the firmware on the device writes the EEPROM
+            if(verbose)
+            {
+                NSLog(@"Running firmware: write EEPROM");
+            }
+            
+            const uint8_t config =
+                [[args valueForKey:kArgConfigByte] unsignedCharValue];
+            status = ezusb_load_eeprom(dev,
+                                       [args valueForKey:kArgHexFile],
+                                       partType,
+                                       config);
+        }
+        else if(stage2 != nil)
         {
             // first stage: put laoder into internal memory
             if(verbose)
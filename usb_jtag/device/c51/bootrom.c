@@ -0,0 +1,118 @@
+/*-----------------------------------------------------------------------------
+ * FX2 boot EEPROM access on the I2C bus
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "fx2regs.h"
+#include "i2c.h"
+#include "bootrom.h"
+
+//-----------------------------------------------------------------------------
+// The FX2 looks for its boot EEPROM at I2C address 0x50 (one address byte)
+// or 0x51 (two address bytes). Page sizes vary; 8 bytes is safe for small
+// and 32 bytes for large parts, larger ones may be requested by the host.
+
+#define BOOTROM_SMALL       0x50
+#define BOOTROM_LARGE       0x51
+
+#define BOOTROM_PAGE_SMALL  8
+#define BOOTROM_PAGE_LARGE  32
+#define BOOTROM_PAGE_MAX    64
+
+#define BOOTROM_POLL_MAX    2000 /* ACK polls, >20ms at 400 kHz */
+
+static unsigned char bootrom_addr;
+static xdata unsigned char bootrom_buf[2+BOOTROM_PAGE_MAX];
+
+//-----------------------------------------------------------------------------
+
+void bootrom_init(void)
+{
+  I2CTL |= bm400KHZ;
+
+  if(i2c_write(BOOTROM_LARGE, bootrom_buf, 0))
+    bootrom_addr = BOOTROM_LARGE;
+  else if(i2c_write(BOOTROM_SMALL, bootrom_buf, 0))
+    bootrom_addr = BOOTROM_SMALL;
+  else
+    bootrom_addr = 0;
+}
+
+unsigned char bootrom_type(void)
+{
+  if(bootrom_addr == BOOTROM_LARGE) return 2;
+  if(bootrom_addr == BOOTROM_SMALL) return 1;
+  return 0;
+}
+
+static unsigned char bootrom_set_address(unsigned short addr, unsigned char len)
+{
+  /* Put address in front of len bytes already in bootrom_buf, then send */
+
+  if(bootrom_addr == BOOTROM_LARGE)
+  {
+    bootrom_buf[0] = addr >> 8;
+    bootrom_buf[1] = addr;
+    return i2c_write(bootrom_addr, bootrom_buf, 2+len);
+  };
+
+  bootrom_buf[1] = addr;
+  return i2c_write(bootrom_addr, bootrom_buf+1, 1+len);
+}
+
+unsigned char bootrom_read(unsigned short addr, xdata unsigned char *buf, unsigned char len)
+{
+  if(bootrom_addr == 0) return 0;
+  if(!bootrom_set_address(addr, 0)) return 0;
+
+  return i2c_read(bootrom_addr, buf, len);
+}
+
+unsigned char bootrom_write(unsigned short addr, xdata unsigned char *buf, unsigned char len, unsigned char page)
+{
+  if(bootrom_addr == 0) return 0;
+
+  if(page == 0 || page > BOOTROM_PAGE_MAX || (page & (page-1)))
+    page = (bootrom_addr == BOOTROM_LARGE) ? BOOTROM_PAGE_LARGE : BOOTROM_PAGE_SMALL;
+
+  while(len > 0)
+  {
+    unsigned char i, n;
+    unsigned short t;
+
+    /* Up to the end of the page containing addr */
+
+    n = page - (addr & (page-1));
+    if(n > len) n = len;
+
+    for(i=0;i<n;i++) bootrom_buf[2+i] = *buf++;
+
+    if(!bootrom_set_address(addr, n)) return 0;
+
+    /* The EEPROM doesn't ACK its address until the write cycle is done */
+
+    for(t=0; !i2c_write(bootrom_addr, bootrom_buf, 0); t++)
+    {
+      if(t == BOOTROM_POLL_MAX) return 0;
+    };
+
+    addr += n;
+    len -= n;
+  };
+
+  return 1;
+}
+
@@ -0,0 +1,36 @@
+/*-----------------------------------------------------------------------------
+ * FX2 boot EEPROM access on the I2C bus
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _BOOTROM_H
+#define _BOOTROM_H 1
+
+/* Switch I2C to 400 kHz and find out which kind of EEPROM is there */
+extern void bootrom_init(void);
+
+/* 0: none, 1: one address byte (e.g. 24LC02), 2: two address bytes
+   (24LC64 and up, which the FX2 can boot from with firmware) */
+extern unsigned char bootrom_type(void);
+
+/* Returns nonzero on success. bootrom_write() uses page writes of the
+   given size (power of two, 0: default for the EEPROM type) and waits
+   for the end of each write cycle by polling for an ACK. */
+extern unsigned char bootrom_read(unsigned short addr, xdata unsigned char *buf, unsigned char len);
+extern unsigned char bootrom_write(unsigned short addr, xdata unsigned char *buf, unsigned char len, unsigned char page);
+
+#endif /* _BOOTROM_H */
+
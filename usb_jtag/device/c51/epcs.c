@@ -0,0 +1,207 @@
+/*-----------------------------------------------------------------------------
+ * EPCS serial configuration device programming
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "fx2regs.h"
+#include "hardware.h"
+#include "usbjtag.h"
+#include "epcs.h"
+
+//-----------------------------------------------------------------------------
+// Pin states, same encoding as in bit banging mode (see usbjtag.c):
+// DCLK low, nCONFIG low, nCE high, ASDI low, output enabled, and nCS
+// either high (idle) or low (device selected).
+
+#define EPCS_IDLE           (bmBIT2|bmBIT3|bmBIT5)
+#define EPCS_SELECT         (bmBIT2|bmBIT5)
+
+// EPCS instructions
+
+#define EPCS_WRITE_ENABLE   0x06
+#define EPCS_READ_STATUS    0x05
+#define EPCS_READ_BYTES     0x03
+#define EPCS_PAGE_PROGRAM   0x02
+#define EPCS_ERASE_SECTOR   0xD8
+#define EPCS_ERASE_BULK     0xC7
+
+#define EPCS_STATUS_WIP     bmBIT0
+
+// What epcs_poll() is doing
+
+#define EPCS_READING        0
+#define EPCS_WAITING        1
+
+static unsigned char epcs_state;
+static xdata unsigned short epcs_count;
+
+//-----------------------------------------------------------------------------
+
+static unsigned char epcs_reverse(unsigned char x)
+{
+  unsigned char i, r = 0;
+
+  for(i=0;i<8;i++)
+  {
+    r = (r<<1) | (x&1);
+    x >>= 1;
+  };
+
+  return r;
+}
+
+static void epcs_out(unsigned char x)
+{
+  /* The shift routines send LSB first, EPCS expects MSB first */
+
+  ProgIO_ShiftOut(epcs_reverse(x));
+}
+
+static void epcs_instruction(unsigned char x)
+{
+  ProgIO_Set_State(EPCS_SELECT);
+  epcs_out(x);
+}
+
+static void epcs_address(unsigned long addr)
+{
+  epcs_out(addr>>16);
+  epcs_out(addr>>8);
+  epcs_out(addr);
+}
+
+static void epcs_deselect(void)
+{
+  ProgIO_Set_State(EPCS_IDLE);
+}
+
+static void epcs_write_enable(void)
+{
+  epcs_instruction(EPCS_WRITE_ENABLE);
+  epcs_deselect();
+}
+
+static unsigned char epcs_status(void)
+{
+  unsigned char s;
+
+  epcs_instruction(EPCS_READ_STATUS);
+  s = epcs_reverse(ProgIO_ShiftInOut(0));
+  epcs_deselect();
+
+  return s;
+}
+
+//-----------------------------------------------------------------------------
+
+unsigned char epcs_read_begin(unsigned long addr, unsigned short len)
+{
+  if(len == 0) return 0;
+
+  epcs_instruction(EPCS_READ_BYTES);
+  epcs_address(addr);
+
+  epcs_count = len;
+  epcs_state = EPCS_READING;
+
+  return 1;
+}
+
+void epcs_program_begin(unsigned long addr)
+{
+  epcs_write_enable();
+  epcs_instruction(EPCS_PAGE_PROGRAM);
+  epcs_address(addr);
+}
+
+void epcs_program_data(unsigned short n)
+{
+  /* Data bytes are sent as they come, i.e. LSB first */
+
+  while(n > 0)
+  {
+    unsigned char k = (n > 0xFF) ? 0xFF : n;
+    ProgIO_ShiftOut_Block(k);
+    n -= k;
+  };
+}
+
+void epcs_program_end(void)
+{
+  epcs_deselect(); /* starts the write cycle */
+  epcs_state = EPCS_WAITING;
+}
+
+void epcs_erase(unsigned long addr, unsigned char bulk)
+{
+  epcs_write_enable();
+
+  if(bulk)
+  {
+    epcs_instruction(EPCS_ERASE_BULK);
+  }
+  else
+  {
+    epcs_instruction(EPCS_ERASE_SECTOR);
+    epcs_address(addr);
+  };
+
+  epcs_deselect();
+  epcs_state = EPCS_WAITING;
+}
+
+unsigned char epcs_poll(void)
+{
+  unsigned char n = OutputSpace();
+
+  if(epcs_state == EPCS_READING)
+  {
+    /* Return only as much as fits, and no more than a packet per call */
+
+    if(n > 0x3E) n = 0x3E;
+    if(n > epcs_count) n = epcs_count;
+    epcs_count -= n;
+
+    while(n--) OutputByte(ProgIO_ShiftInOut(0));
+
+    if(epcs_count > 0) return 0;
+
+    epcs_deselect();
+    return 1;
+  };
+
+  /* Wait for program/erase cycle to complete. This takes up to some
+     seconds for a bulk erase, so it's a single status read per call. */
+
+  if(n > 0)
+  {
+    unsigned char s = epcs_status();
+
+    if(!(s & EPCS_STATUS_WIP))
+    {
+      OutputByte(s);
+      return 1;
+    };
+  };
+
+  return 0;
+}
+
+void epcs_abort(void)
+{
+  epcs_deselect();
+}
+
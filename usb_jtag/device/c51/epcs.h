@@ -0,0 +1,41 @@
+/*-----------------------------------------------------------------------------
+ * EPCS serial configuration device programming
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _EPCS_H
+#define _EPCS_H 1
+
+/* Start reading len bytes at addr; returns 0 if there's nothing to read */
+extern unsigned char epcs_read_begin(unsigned long addr, unsigned short len);
+
+/* Program a page at addr with data passed to epcs_program_data() */
+extern void epcs_program_begin(unsigned long addr);
+extern void epcs_program_data(unsigned short n);
+extern void epcs_program_end(void);
+
+/* Erase the sector containing addr, or the whole device */
+extern void epcs_erase(unsigned long addr, unsigned char bulk);
+
+/* Continue operation; returns nonzero when it is complete */
+extern unsigned char epcs_poll(void);
+
+/* Give up the current operation: release nCS. An interrupted page program
+   then writes the bytes received so far. */
+extern void epcs_abort(void);
+
+#endif /* _EPCS_H */
+
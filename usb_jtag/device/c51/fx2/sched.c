@@ -0,0 +1,126 @@
+/* -*- c++ -*- */
+/*-----------------------------------------------------------------------------
+ * Cooperative timer scheduler for FX2
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "sched.h"
+#include "timer.h"
+#include "fx2regs.h"
+#include "isr.h"
+
+volatile unsigned short sched_tick_count;
+
+static xdata sched_func sched_slot_func[SCHED_SLOTS];
+static xdata unsigned short sched_slot_due[SCHED_SLOTS];
+static xdata unsigned short sched_slot_period[SCHED_SLOTS];
+
+static void
+isr_sched_tick (void) interrupt
+{
+  clear_timer_irq ();
+  sched_tick_count++;
+}
+
+void
+sched_init (void)
+{
+  unsigned char i;
+
+  for (i = 0; i < SCHED_SLOTS; i++)
+    sched_slot_func[i] = 0;
+
+  sched_tick_count = 0;
+  hook_timer_tick ((unsigned short) isr_sched_tick);
+}
+
+unsigned short
+sched_ticks (void)
+{
+  unsigned short t;
+
+  ET2 = 0;
+  t = sched_tick_count;
+  ET2 = 1;
+
+  return t;
+}
+
+unsigned short
+sched_elapsed (unsigned short start)
+{
+  return sched_ticks () - start;
+}
+
+static unsigned char
+sched_add (unsigned short ticks, unsigned short period, sched_func f)
+{
+  unsigned char i;
+
+  for (i = 0; i < SCHED_SLOTS; i++)
+    if (sched_slot_func[i] == 0)
+      {
+	sched_slot_due[i] = sched_ticks () + ticks;
+	sched_slot_period[i] = period;
+	sched_slot_func[i] = f;
+	return i;
+      }
+
+  return SCHED_NONE;
+}
+
+unsigned char
+sched_after (unsigned short ticks, sched_func f)
+{
+  return sched_add (ticks, 0, f);
+}
+
+unsigned char
+sched_every (unsigned short ticks, sched_func f)
+{
+  return sched_add (ticks, ticks, f);
+}
+
+void
+sched_cancel (unsigned char slot)
+{
+  if (slot < SCHED_SLOTS)
+    sched_slot_func[slot] = 0;
+}
+
+void
+sched_run (void)
+{
+  unsigned char i;
+  unsigned short now = sched_ticks ();
+
+  for (i = 0; i < SCHED_SLOTS; i++)
+    {
+      sched_func f = sched_slot_func[i];
+
+      if (f == 0 || (short) (now - sched_slot_due[i]) < 0)
+	continue;
+
+      /* free or re-arm the slot first, so that f may reuse or cancel it */
+
+      if (sched_slot_period[i])
+	sched_slot_due[i] += sched_slot_period[i];
+      else
+	sched_slot_func[i] = 0;
+
+      (*f) ();
+    }
+}
@@ -0,0 +1,73 @@
+/* -*- c++ -*- */
+/*-----------------------------------------------------------------------------
+ * Cooperative timer scheduler for FX2
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+/*
+ * Timer 2 interrupts at SCHED_HZ (see hook_timer_tick) and only counts
+ * ticks. Callbacks are run from the main loop by sched_run, so they may
+ * take their time and use everything the main loop does, but should not
+ * wait themselves: a delay is a callback scheduled for later, a timeout
+ * is a check of sched_elapsed.
+ */
+
+#define SCHED_HZ      100
+#define SCHED_SLOTS   4
+#define SCHED_NONE    0xFF
+
+typedef void (*sched_func) (void);
+
+/* ticks counted so far, read with ET2 = 0 or through sched_ticks */
+extern volatile unsigned short sched_tick_count;
+
+/*
+ * clear all slots and start counting ticks
+ */
+void sched_init (void);
+
+/*
+ * number of ticks since sched_init
+ */
+unsigned short sched_ticks (void);
+
+/*
+ * number of ticks since sched_ticks returned start
+ */
+unsigned short sched_elapsed (unsigned short start);
+
+/*
+ * call f once after ticks ticks (sched_after) or every ticks ticks
+ * (sched_every, without drift). Returns the slot, for sched_cancel,
+ * or SCHED_NONE if all slots are in use.
+ */
+unsigned char sched_after (unsigned short ticks, sched_func f);
+unsigned char sched_every (unsigned short ticks, sched_func f);
+
+/*
+ * free a slot before its callback is due (again)
+ */
+void sched_cancel (unsigned char slot);
+
+/*
+ * call the callbacks that are due; to be called from the main loop
+ */
+void sched_run (void);
+
+#endif /* _SCHED_H_ */
@@ -20,15 +20,48 @@
 #define _HARDWARE_H 1
 
 extern void ProgIO_Init(void);
-extern void ProgIO_Poll(void);
+/* Called repeatedly until it returns nonzero: target is ready (supply up) */
+extern unsigned char ProgIO_Poll(void);
 extern void ProgIO_Enable(void);
 extern void ProgIO_Disable(void);
 extern void ProgIO_Deinit(void);
 
 extern void ProgIO_Set_State(unsigned char d);
 extern unsigned char ProgIO_Set_Get_State(unsigned char d);
+extern unsigned char ProgIO_Get_State(void);
 extern void ProgIO_ShiftOut(unsigned char x);
 extern unsigned char ProgIO_ShiftInOut(unsigned char x);
 
+/* Shift out n (1..255) bytes fetched through autopointer 1 (XAUTODAT1) */
+extern void ProgIO_ShiftOut_Block(unsigned char n);
+
+/* Give 4 TCK cycles with (TMS, TDI) from bits (0, 1), (2, 3), (4, 5) and
+ * (6, 7) of v; returns TDO, read before each rising edge, in bits 0..3 */
+extern unsigned char ProgIO_Vector(unsigned char v);
+
+/* Select when ProgIO_ShiftInOut samples TDO: 0 right after the falling
+ * edge of TCK (default), 1..254 after that many delay loop iterations,
+ * TDO_SAMPLE_LATE only after the falling edge that ends the bit, for TDO
+ * delayed by about a TCK cycle (long cables, level shifters). */
+#define TDO_SAMPLE_LATE 0xFF
+extern void ProgIO_Set_Sample_Point(unsigned char s);
+
+/* Adaptive clocking for targets that return TCK on RTCK: with t nonzero,
+ * each TCK edge waits until RTCK follows, for at most t polling loops
+ * (about 1us each), and the kernels ignore the sample point. 0 turns it
+ * off (default). Returns the number of RTCK timeouts (up to 255) since the
+ * previous call; hardware without RTCK ignores t and returns 0. */
+extern unsigned char ProgIO_Set_Adaptive(unsigned char t);
+
+/* Adapters with more than one JTAG chain: make chain c (0 after
+ * ProgIO_Init) the one all other functions work on. See hw_xpcu.c. */
+#ifdef hw_xpcu
+#define PROGIO_CHAINS 2
+extern void ProgIO_Set_Chain(unsigned char c);
+#else
+#define PROGIO_CHAINS 1
+#define ProgIO_Set_Chain(c) while(0){}
+#endif
+
 #endif /* _HARDWARE_H */
 
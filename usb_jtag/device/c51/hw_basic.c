@@ -18,6 +18,7 @@
 
 #include <fx2regs.h>
 #include "hardware.h"
+#include "usbjtag.h"
 #include "delay.h"
 
 //-----------------------------------------------------------------------------
@@ -30,6 +31,9 @@
 // comment in (define!) if you want outputs disabled when possible
 #define HAVE_OENABLE 1
 
+// comment in (define!) if RTCK is connected to Port A.0 for adaptive clocking
+//#define HAVE_RTCK    1
+
 //-----------------------------------------------------------------------------
 
 /* JTAG TCK, AS/PS DCLK */
@@ -106,6 +110,17 @@ sbit at 0xA1          TDO; /* Port C.1 */
 
 //-----------------------------------------------------------------------------
 
+#ifdef HAVE_RTCK
+
+  /* JTAG RTCK, returned clock for adaptive clocking */
+
+  sbit at 0x80        RTCK; /* Port A.0 */
+  #define GetRTCK(x)  RTCK
+
+#endif
+
+//-----------------------------------------------------------------------------
+
 #ifdef HAVE_OE_LED
 
   sbit at 0xA7        OELED; /* Port C.7 */
@@ -126,7 +141,31 @@ sbit at 0xA1          TDO; /* Port C.1 */
 
 //-----------------------------------------------------------------------------
 
-void ProgIO_Poll(void)    {}
+// Target supply needs 500ms to come up. Instead of waiting in ProgIO_Init,
+// which would delay renumeration, ProgIO_Poll reports when it's done. With
+// a power-good input, check that instead of the time.
+
+#define POWER_UP_TICKS 50
+
+static unsigned char PowerUp;
+static unsigned short PowerUpStart;
+
+unsigned char ProgIO_Poll(void)
+{
+  if(!PowerUp) return 1;
+  if((unsigned short)(TickCount() - PowerUpStart) < POWER_UP_TICKS) return 0;
+
+  PowerUp = 0;
+
+#ifdef HAVE_OENABLE
+  OEC=(OEC&~(bmPROGINOE | bmPROGOUTOE)); // Output disable
+#else
+  OEC=(OEC&~bmPROGINOE) | bmPROGOUTOE; // Output enable
+#endif
+
+  return 1;
+}
+
 // These aren't called anywhere in usbjtag.c, but I plan to do so...
 void ProgIO_Enable(void)  {}
 void ProgIO_Disable(void) {}
@@ -147,15 +186,100 @@ void ProgIO_Init(void)
   // power on the onboard FPGA and all other VCCs, de-assert RESETN
   IOE = 0x1F;
   OEE = 0x1F;
-  mdelay(500); // wait for supply to come up
 
-#ifdef HAVE_OENABLE
-  OEC=(OEC&~(bmPROGINOE | bmPROGOUTOE)); // Output disable
-#else
-  OEC=(OEC&~bmPROGINOE) | bmPROGOUTOE; // Output enable
-#endif
+  // wait for supply to come up, see ProgIO_Poll
+  PowerUp = 1;
+  PowerUpStart = TickCount();
+}
+
+//-----------------------------------------------------------------------------
+// Adaptive clocking: with ProgIO_Set_Adaptive(t), every TCK edge waits until
+// RTCK follows. The kernels below are slower than the unrolled ones, but
+// the target sets the pace, not the worst case.
+
+#ifdef HAVE_RTCK
+
+static unsigned char Adaptive;     /* see ProgIO_Set_Adaptive() */
+static unsigned char RTCKTimeouts;
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  unsigned char n = RTCKTimeouts;
+
+  Adaptive = t;
+  RTCKTimeouts = 0;
+  return n;
+}
+
+static void AdaptiveTCK(unsigned char x)
+{
+  /* Set TCK to x, then wait for RTCK to follow, at most Adaptive loops */
+
+  unsigned char n = Adaptive;
+
+  SetTCK(x);
+  while(GetRTCK() != x)
+  {
+    if(--n == 0)
+    {
+      if(RTCKTimeouts != 0xFF) RTCKTimeouts++;
+      return;
+    };
+  };
+}
+
+static unsigned char ShiftAdaptive(unsigned char c)
+{
+  /* As ProgIO_ShiftInOut, each TCK edge paced by RTCK */
+
+  unsigned char k, t;
+
+  for(k=0;k<8;k++)
+  {
+    t = GetTDO();
+    SetTDI(c & 1);
+    c = (c >> 1) | (t ? 0x80 : 0);
+    AdaptiveTCK(1);
+    AdaptiveTCK(0);
+  };
+
+  return c;
+}
+
+static void ShiftBlockAdaptive(unsigned char n)
+{
+  do ShiftAdaptive(XAUTODAT1); while(--n);
+}
+
+static unsigned char VectorAdaptive(unsigned char v)
+{
+  /* As ProgIO_Vector, each TCK edge paced by RTCK */
+
+  unsigned char k, r = 0;
+
+  for(k=0;k<4;k++)
+  {
+    SetTMS(v & 1);
+    SetTDI((v >> 1) & 1);
+    if(GetTDO()) r |= 1 << k;
+    AdaptiveTCK(1);
+    AdaptiveTCK(0);
+    v >>= 2;
+  };
+
+  return r;
+}
+
+#else /* HAVE_RTCK */
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  (void)t;
+  return 0;
 }
 
+#endif /* HAVE_RTCK */
+
 void ProgIO_Set_State(unsigned char d)
 {
   /* Set state of output pins:
@@ -173,6 +297,9 @@ void ProgIO_Set_State(unsigned char d)
     OEC=(OEC&~(bmPROGINOE | bmPROGOUTOE)); // Output disable
 #endif
 
+#ifdef HAVE_RTCK
+  if(!Adaptive)
+#endif
   SetTCK((d & bmBIT0) ? 1 : 0);
   SetTMS((d & bmBIT1) ? 1 : 0);
 #ifdef HAVE_AS_MODE
@@ -188,6 +315,10 @@ void ProgIO_Set_State(unsigned char d)
   if((d & bmBIT5) != 0)
     OEC=(OEC&~bmPROGINOE) | bmPROGOUTOE; // Output enable
 #endif
+
+#ifdef HAVE_RTCK
+  if(Adaptive) AdaptiveTCK((d & bmBIT0) ? 1 : 0); // edge last, once paced
+#endif
 }
 
 unsigned char ProgIO_Set_Get_State(unsigned char d)
@@ -200,6 +331,13 @@ unsigned char ProgIO_Set_Get_State(unsigned char d)
    */
 
   ProgIO_Set_State(d);
+  return ProgIO_Get_State();
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  /* Read state of input pins only (s.a.) */
+
   return (GetASDO()<<1)|GetTDO();
 }
 
@@ -220,6 +358,12 @@ void ProgIO_ShiftOut(unsigned char c)
   (void)c; /* argument passed in DPL */
 
   _asm
+#ifdef HAVE_RTCK
+        MOV  A,_Adaptive
+        JZ   00099$
+        LJMP _ShiftAdaptive
+00099$:
+#endif
         MOV  A,DPL
         ;; Bit0
         RRC  A
@@ -266,11 +410,91 @@ void ProgIO_ShiftOut(unsigned char c)
   _endasm;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out n bytes, fetched through autopointer 1:
+   *
+   * n x {
+   *   Read next byte from XAUTODAT1
+   *   Shift it out like ProgIO_ShiftOut does
+   * }
+   *
+   * n must not be zero (it would be taken as 256).
+   */
+
+  (void)n; /* argument passed in DPL */
+
+  _asm
+#ifdef HAVE_RTCK
+        MOV  A,_Adaptive
+        JZ   00099$
+        LJMP _ShiftBlockAdaptive
+00099$:
+#endif
+        MOV  R2,DPL
+        MOV  DPTR,#_XAUTODAT1
+00001$:
+        MOVX A,@DPTR
+        ;; Bit0
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit1
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit2
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit3
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit4
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit5
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit6
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit7
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        NOP
+        CLR  _TCK
+        DJNZ R2,00001$
+        ret
+  _endasm;
+}
+
+static unsigned char SamplePoint; /* see ProgIO_Set_Sample_Point() */
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  SamplePoint = s;
+}
+
 /*
 ;; For ShiftInOut, the timing is a little more
 ;; critical because we have to read _TDO/shift/set _TDI
 ;; when _TCK is low. But 20% duty cycle at 48/4/5 MHz
-;; is just like 50% at 6 Mhz, and that's still acceptable
+;; is just like 50% at 6 Mhz, and that's still acceptable.
+;; If TDO arrives late, SamplePoint selects a kernel that
+;; waits before sampling or samples after the falling edge.
 */
 
 #if HAVE_AS_MODE
@@ -307,6 +531,14 @@ unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c)
    (void)c; /* argument passed in DPL */
 
   _asm
+#ifdef HAVE_RTCK
+        MOV  A,_Adaptive
+        JZ   00099$
+        LJMP _ShiftAdaptive
+00099$:
+#endif
+        MOV  A,_SamplePoint
+        JNZ  00010$
         MOV  A,DPL
 
         ;; Bit0
@@ -360,6 +592,38 @@ unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c)
 
         MOV  DPL,A
         ret
+
+;; Slower kernels, selected by SamplePoint
+00010$:
+        MOV  R2,#8
+        CJNE A,#0xFF,00020$
+        MOV  A,DPL
+;; TDO_SAMPLE_LATE: sample after the falling edge
+00011$:
+        MOV  C,acc.0
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        RRC  A
+        DJNZ R2,00011$
+        MOV  DPL,A
+        ret
+;; Delay SamplePoint loops (3 cycles each) before sampling
+00020$:
+        MOV  A,DPL
+00021$:
+        MOV  R3,_SamplePoint
+00022$:
+        DJNZ R3,00022$
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        DJNZ R2,00021$
+        MOV  DPL,A
+        ret
   _endasm;
 
   /* return value in DPL */
@@ -367,6 +631,75 @@ unsigned char ProgIO_ShiftInOut_JTAG(unsigned char c)
   return c;
 }
 
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  /* Give 4 TCK cycles, for each:
+   *
+   *   Output v.0 on TMS, v.1 on TDI
+   *   Read TDO into the next bit of the result
+   *   Raise TCK
+   *   Lower TCK
+   *   Shift v right by two
+   *
+   * Return the TDO bits in bits 0..3.
+   */
+
+  (void)v; /* argument passed in DPL */
+
+  _asm
+#ifdef HAVE_RTCK
+        MOV  A,_Adaptive
+        JZ   00099$
+        LJMP _VectorAdaptive
+00099$:
+#endif
+        MOV  A,DPL
+        MOV  B,#0
+        ;; Clock0
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.0,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock1
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.1,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock2
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.2,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock3
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.3,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  DPL,B
+        ret
+  _endasm;
+
+  /* return value in DPL */
+
+  return v;
+}
+
 #ifdef HAVE_AS_MODE
 
 unsigned char ProgIO_ShiftInOut_AS(unsigned char c)
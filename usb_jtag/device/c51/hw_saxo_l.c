@@ -53,7 +53,7 @@ sbit at 0xB1          TDO;
 
 //-----------------------------------------------------------------------------
 
-void ProgIO_Poll(void)    {}
+unsigned char ProgIO_Poll(void) { return 1; }
 // These aren't called anywhere in usbjtag.c, but I plan to do so...
 void ProgIO_Enable(void)  {}
 void ProgIO_Disable(void) {}
@@ -102,6 +102,13 @@ unsigned char ProgIO_Set_Get_State(unsigned char d)
    */
 
   ProgIO_Set_State(d);
+  return ProgIO_Get_State();
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  /* Read state of input pins only (s.a.) */
+
   return 2|GetTDO(); /* DATAOUT assumed high, no AS mode */
 }
 
@@ -168,11 +175,91 @@ void ProgIO_ShiftOut(unsigned char c)
   _endasm;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out n bytes, fetched through autopointer 1:
+   *
+   * n x {
+   *   Read next byte from XAUTODAT1
+   *   Shift it out like ProgIO_ShiftOut does
+   * }
+   *
+   * n must not be zero (it would be taken as 256).
+   */
+
+  (void)n; /* argument passed in DPL */
+
+  _asm
+        MOV  R2,DPL
+        MOV  DPTR,#_XAUTODAT1
+00001$:
+        MOVX A,@DPTR
+        ;; Bit0
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit1
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit2
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit3
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit4
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit5
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit6
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        ;; Bit7
+        RRC  A
+        CLR  _TCK
+        MOV  _TDI,C
+        SETB _TCK
+        NOP
+        CLR  _TCK
+        DJNZ R2,00001$
+        ret
+  _endasm;
+}
+
+static unsigned char SamplePoint; /* see ProgIO_Set_Sample_Point() */
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  SamplePoint = s;
+}
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  (void)t; /* no RTCK input */
+  return 0;
+}
+
 /*
 ;; For ShiftInOut, the timing is a little more
 ;; critical because we have to read _TDO/shift/set _TDI
 ;; when _TCK is low. But 20% duty cycle at 48/4/5 MHz
-;; is just like 50% at 6 Mhz, and that's still acceptable
+;; is just like 50% at 6 Mhz, and that's still acceptable.
+;; If TDO arrives late, SamplePoint selects a kernel that
+;; waits before sampling or samples after the falling edge.
 */
 
 unsigned char ProgIO_ShiftInOut(unsigned char c)
@@ -192,6 +279,8 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
    (void)c; /* argument passed in DPL */
 
   _asm
+        MOV  A,_SamplePoint
+        JNZ  00010$
         MOV  A,DPL
 
         ;; Bit0
@@ -245,6 +334,38 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
 
         MOV  DPL,A
         ret
+
+;; Slower kernels, selected by SamplePoint
+00010$:
+        MOV  R2,#8
+        CJNE A,#0xFF,00020$
+        MOV  A,DPL
+;; TDO_SAMPLE_LATE: sample after the falling edge
+00011$:
+        MOV  C,acc.0
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  C,_TDO
+        RRC  A
+        DJNZ R2,00011$
+        MOV  DPL,A
+        ret
+;; Delay SamplePoint loops (3 cycles each) before sampling
+00020$:
+        MOV  A,DPL
+00021$:
+        MOV  R3,_SamplePoint
+00022$:
+        DJNZ R3,00022$
+        MOV  C,_TDO
+        RRC  A
+        MOV  _TDI,C
+        SETB _TCK
+        CLR  _TCK
+        DJNZ R2,00021$
+        MOV  DPL,A
+        ret
   _endasm;
 
   /* return value in DPL */
@@ -252,5 +373,66 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
   return c;
 }
 
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  /* Give 4 TCK cycles, for each:
+   *
+   *   Output v.0 on TMS, v.1 on TDI
+   *   Read TDO into the next bit of the result
+   *   Raise TCK
+   *   Lower TCK
+   *   Shift v right by two
+   *
+   * Return the TDO bits in bits 0..3.
+   */
+
+  (void)v; /* argument passed in DPL */
 
+  _asm
+        MOV  A,DPL
+        MOV  B,#0
+        ;; Clock0
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.0,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock1
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.1,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock2
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.2,C
+        SETB _TCK
+        CLR  _TCK
+        ;; Clock3
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        MOV  _TDI,C
+        MOV  C,_TDO
+        MOV  b.3,C
+        SETB _TCK
+        CLR  _TCK
+        MOV  DPL,B
+        ret
+  _endasm;
+
+  /* return value in DPL */
+
+  return v;
+}
 
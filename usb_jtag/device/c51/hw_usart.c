@@ -0,0 +1,356 @@
+/*-----------------------------------------------------------------------------
+ * Hardware-dependent code for usb_jtag
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ * Bit banging code taken from hw_basic.c,
+ * Copyright (C) 2007 Kolja Waschk, ixo.de
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include <fx2regs.h>
+#include "hardware.h"
+#include "delay.h"
+
+//-----------------------------------------------------------------------------
+// Adapter with TDI/TCK also driven by USART0 in mode 0 (synchronous shift
+// register), which shifts out whole bytes without CPU work per bit. Needs
+// an FX2 package with the TXD0 and PE3 pins (100 or 128 pins):
+//
+//  TDI: PE3, as GPIO for bit banging or as RXD0OUT (the mode 0 data
+//       output) while bytes are shifted out by the USART.
+//  TCK: NAND of TXD0 (mode 0 clock, high when idle) and nTCK on PD0, e.g.
+//       a 74LVC1G00. PD0 is held high while the USART is shifting, so TCK
+//       follows TXD0 inverted and rises in the middle of each data bit.
+//  TMS: PD2
+//  TDO: PD1
+//
+// USART0 is clocked at CLKOUT/4 (12 MHz TCK at 48 MHz). Clear SM2 in
+// ProgIO_Init for CLKOUT/12 if the target or the wiring can't keep up.
+
+/* JTAG TCK, inverted, see above */
+
+sbit at 0xB0          NTCK;
+#define bmNTCKOE      bmBIT0
+#define SetTCK(x)     do{NTCK=!(x);}while(0)
+
+/* JTAG TDI */
+
+#define bmTDI         bmBIT3 /* in IOE, OEE and PORTECFG (bmRXD0OUT) */
+#define SetTDI(x)     do{if(x) IOE|=bmTDI; else IOE&=~bmTDI;}while(0)
+
+/* JTAG TMS */
+
+sbit at 0xB2          TMS;
+#define bmTMSOE       bmBIT2
+#define SetTMS(x)     do{TMS=(x);}while(0)
+
+/* JTAG TDO */
+
+sbit at 0xB1          TDO;
+#define bmTDOOE       bmBIT1
+#define GetTDO(x)     TDO
+
+//-----------------------------------------------------------------------------
+
+#define bmPROGOUTOE (bmNTCKOE|bmTMSOE)
+#define bmPROGINOE  (bmTDOOE)
+
+//-----------------------------------------------------------------------------
+
+unsigned char ProgIO_Poll(void) { return 1; }
+// These aren't called anywhere in usbjtag.c, but I plan to do so...
+void ProgIO_Enable(void)  {}
+void ProgIO_Disable(void) {}
+void ProgIO_Deinit(void)  {}
+
+
+void ProgIO_Init(void)
+{
+  /* The following code depends on your actual circuit design.
+     Make required changes _before_ you try the code! */
+
+  // set the CPU clock to 48MHz, enable clock output to FPGA
+  CPUCS = bmCLKOE | bmCLKSPD1;
+
+  // Use internal 48 MHz, enable output, use "Port" mode for all pins
+  IFCONFIG = bmIFCLKSRC | bm3048MHZ | bmIFCLKOE;
+
+  // TCK low, TDO input, others output
+  NTCK = 1;
+  OED = (OED&~bmPROGINOE) | bmPROGOUTOE;
+
+  PORTECFG &= ~bmRXD0OUT;
+  IOE &= ~bmTDI;
+  OEE |= bmTDI;
+
+  // USART0 mode 0 (SM0=SM1=0), CLKOUT/4 (SM2=1), no reception. TI set
+  // means "idle" to the shift functions below.
+  SCON0 = 0x20;
+  TI = 1;
+}
+
+void ProgIO_Set_State(unsigned char d)
+{
+  /* Set state of output pins:
+   *
+   * d.0 => TCK
+   * d.1 => TMS
+   * d.4 => TDI
+   */
+
+  SetTCK((d & bmBIT0) ? 1 : 0);
+  SetTMS((d & bmBIT1) ? 1 : 0);
+  SetTDI((d & bmBIT4) ? 1 : 0);
+}
+
+unsigned char ProgIO_Set_Get_State(unsigned char d)
+{
+  /* Set state of output pins (s.a.)
+   * then read state of input pins:
+   *
+   * TDO => d.0
+   */
+
+  ProgIO_Set_State(d);
+  return ProgIO_Get_State();
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  /* Read state of input pins only (s.a.) */
+
+  return 2|GetTDO(); /* DATAOUT assumed high, no AS mode */
+}
+
+//-----------------------------------------------------------------------------
+
+void ProgIO_ShiftOut(unsigned char c)
+{
+  /* Shift out byte C through the USART, LSB first like the bit banging
+   * kernels of the other variants. TCK must be low. */
+
+  PORTECFG |= bmRXD0OUT;
+  TI = 0;
+  SBUF0 = c;
+  while(!TI);
+  PORTECFG &= ~bmRXD0OUT;
+}
+
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out n bytes, fetched through autopointer 1:
+   *
+   * Read first byte from XAUTODAT1
+   * n x {
+   *   Wait until the USART is idle (TI)
+   *   Write byte to SBUF0
+   *   Read next byte from XAUTODAT1 while that one is shifted out
+   * }
+   *
+   * n must not be zero (it would be taken as 256).
+   */
+
+  (void)n; /* argument passed in DPL */
+
+  _asm
+        MOV  R2,DPL
+        MOV  DPTR,#_PORTECFG
+        MOVX A,@DPTR
+        ORL  A,#0x08 ; bmRXD0OUT
+        MOVX @DPTR,A
+        MOV  DPTR,#_XAUTODAT1
+        MOVX A,@DPTR
+00001$:
+        JNB  _TI,00001$
+        CLR  _TI
+        MOV  _SBUF0,A
+        DJNZ R2,00002$
+00003$:
+        JNB  _TI,00003$
+        MOV  DPTR,#_PORTECFG
+        MOVX A,@DPTR
+        ANL  A,#0xF7 ; ~bmRXD0OUT
+        MOVX @DPTR,A
+        ret
+00002$:
+        MOVX A,@DPTR
+        SJMP 00001$
+  _endasm;
+}
+
+static unsigned char SamplePoint; /* see ProgIO_Set_Sample_Point() */
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  SamplePoint = s;
+}
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  (void)t; /* no RTCK input */
+  return 0;
+}
+
+static unsigned char ShiftInOut_Slow(unsigned char c)
+{
+  /* Like ProgIO_ShiftInOut, but wait SamplePoint loops before reading TDO
+   * or, with TDO_SAMPLE_LATE, read it after lowering TCK */
+
+  unsigned char i, d;
+  unsigned char lc=c;
+
+  for(i=0;i<8;i++)
+  {
+    if(SamplePoint == TDO_SAMPLE_LATE)
+    {
+      SetTDI(lc&1); NTCK=0; NTCK=1;
+      lc=(TDO?0x80:0)|(lc>>1);
+    }
+    else
+    {
+      for(d=SamplePoint;d;d--);
+      d = TDO?0x80:0; SetTDI(lc&1); NTCK=0; lc=d|(lc>>1); NTCK=1;
+    };
+  };
+
+  return lc;
+}
+
+unsigned char ProgIO_ShiftInOut(unsigned char c)
+{
+  /* Shift out byte C, shift in from TDO (bit banging, the USART can't
+   * do both at once):
+   *
+   * 8x {
+   *   Read carry from TDO
+   *   Output least significant bit on TDI
+   *   Raise TCK
+   *   Shift c right, append carry (TDO) at left
+   *   Lower TCK
+   * }
+   * Return c.
+   */
+
+  (void)c; /* argument passed in DPL */
+
+  _asm
+        MOV  A,_SamplePoint
+        JZ   00004$
+        LJMP _ShiftInOut_Slow
+00004$:
+        MOV  A,DPL
+        MOV  R2,#8
+00001$:
+        MOV  C,_TDO
+        RRC  A
+        JC   00002$
+        ANL  _IOE,#0xF7 ; ~bmTDI
+        SJMP 00003$
+00002$:
+        ORL  _IOE,#0x08 ; bmTDI
+00003$:
+        CLR  _NTCK
+        SETB _NTCK
+        DJNZ R2,00001$
+        MOV  DPL,A
+        ret
+  _endasm;
+
+  /* return value in DPL */
+
+  return c;
+}
+
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  /* Give 4 TCK cycles, for each:
+   *
+   *   Output v.0 on TMS, v.1 on TDI
+   *   Read TDO into the next bit of the result
+   *   Raise TCK
+   *   Lower TCK
+   *   Shift v right by two
+   *
+   * Return the TDO bits in bits 0..3.
+   */
+
+  (void)v; /* argument passed in DPL */
+
+  _asm
+        MOV  A,DPL
+        MOV  B,#0
+        ;; Clock0
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        JC   00010$
+        ANL  _IOE,#0xF7 ; ~bmTDI
+        SJMP 00011$
+00010$:
+        ORL  _IOE,#0x08 ; bmTDI
+00011$:
+        MOV  C,_TDO
+        MOV  b.0,C
+        CLR  _NTCK
+        SETB _NTCK
+        ;; Clock1
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        JC   00012$
+        ANL  _IOE,#0xF7 ; ~bmTDI
+        SJMP 00013$
+00012$:
+        ORL  _IOE,#0x08 ; bmTDI
+00013$:
+        MOV  C,_TDO
+        MOV  b.1,C
+        CLR  _NTCK
+        SETB _NTCK
+        ;; Clock2
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        JC   00014$
+        ANL  _IOE,#0xF7 ; ~bmTDI
+        SJMP 00015$
+00014$:
+        ORL  _IOE,#0x08 ; bmTDI
+00015$:
+        MOV  C,_TDO
+        MOV  b.2,C
+        CLR  _NTCK
+        SETB _NTCK
+        ;; Clock3
+        RRC  A
+        MOV  _TMS,C
+        RRC  A
+        JC   00016$
+        ANL  _IOE,#0xF7 ; ~bmTDI
+        SJMP 00017$
+00016$:
+        ORL  _IOE,#0x08 ; bmTDI
+00017$:
+        MOV  C,_TDO
+        MOV  b.3,C
+        CLR  _NTCK
+        SETB _NTCK
+        MOV  DPL,B
+        ret
+  _endasm;
+
+  /* return value in DPL */
+
+  return v;
+}
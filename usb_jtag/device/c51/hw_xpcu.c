@@ -0,0 +1,110 @@
+/*-----------------------------------------------------------------------------
+ * Hardware-dependent code for usb_jtag
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "hardware.h"
+#include "xpcu.h"
+
+//-----------------------------------------------------------------------------
+// Both chains of the Xilinx Platform Cable USB, see xpcu.h. Each keeps its
+// own state in hw_xpcu_i.c/hw_xpcu_x.c (sample point, pins); switching
+// only reconfigures the ports for the chain taken over.
+
+static unsigned char Chain;
+
+void ProgIO_Set_Chain(unsigned char c)
+{
+  Chain = c;
+  if(Chain == XPCU_CHAIN_I) XpcuI_Init(); else XpcuX_Init();
+}
+
+void ProgIO_Init(void)
+{
+  ProgIO_Set_Chain(XPCU_CHAIN_X);
+}
+
+unsigned char ProgIO_Poll(void)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_Poll();
+  return XpcuX_Poll();
+}
+
+void ProgIO_Enable(void)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_Enable(); else XpcuX_Enable();
+}
+
+void ProgIO_Disable(void)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_Disable(); else XpcuX_Disable();
+}
+
+void ProgIO_Deinit(void)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_Deinit(); else XpcuX_Deinit();
+}
+
+void ProgIO_Set_State(unsigned char d)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_Set_State(d); else XpcuX_Set_State(d);
+}
+
+unsigned char ProgIO_Set_Get_State(unsigned char d)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_Set_Get_State(d);
+  return XpcuX_Set_Get_State(d);
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_Get_State();
+  return XpcuX_Get_State();
+}
+
+void ProgIO_ShiftOut(unsigned char c)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_ShiftOut(c); else XpcuX_ShiftOut(c);
+}
+
+unsigned char ProgIO_ShiftInOut(unsigned char c)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_ShiftInOut(c);
+  return XpcuX_ShiftInOut(c);
+}
+
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_ShiftOut_Block(n); else XpcuX_ShiftOut_Block(n);
+}
+
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_Vector(v);
+  return XpcuX_Vector(v);
+}
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  if(Chain == XPCU_CHAIN_I) XpcuI_Set_Sample_Point(s); else XpcuX_Set_Sample_Point(s);
+}
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  if(Chain == XPCU_CHAIN_I) return XpcuI_Set_Adaptive(t);
+  return XpcuX_Set_Adaptive(t);
+}
+
@@ -17,6 +17,11 @@
  *-----------------------------------------------------------------------------
  */
 
+#ifdef hw_xpcu
+#define XPCU_PREFIX XpcuI
+#include "xpcu.h"
+#endif
+
 #include "hardware.h"
 #include "fx2regs.h"
 #include "syncdelay.h"
@@ -37,7 +42,7 @@ sbit at 0x80+1        OELED;
 
 //-----------------------------------------------------------------------------
 
-void ProgIO_Poll(void)    {}
+unsigned char ProgIO_Poll(void) { return 1; }
 void ProgIO_Enable(void)  {}
 void ProgIO_Disable(void) {}
 void ProgIO_Deinit(void)  {}
@@ -91,6 +96,13 @@ unsigned char ProgIO_Set_Get_State(unsigned char d)
    */
 
   ProgIO_Set_State(d);
+  return ProgIO_Get_State();
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  /* Read state of input pins only (s.a.) */
+
   return 2|GetTDO(); /* DATAOUT assumed high, no AS mode */
 }
 
@@ -119,6 +131,51 @@ void ProgIO_ShiftOut(unsigned char c)
   if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc>>=1; IOE&=~0x08;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out n bytes, fetched through autopointer 1 */
+
+  while(n--) ProgIO_ShiftOut(XAUTODAT1);
+}
+
+static unsigned char SamplePoint; /* see ProgIO_Set_Sample_Point() */
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  SamplePoint = s;
+}
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  (void)t; /* no RTCK input */
+  return 0;
+}
+
+static unsigned char ShiftInOut_Slow(unsigned char c)
+{
+  /* Like ProgIO_ShiftInOut, but wait SamplePoint loops before reading TDO
+   * or, with TDO_SAMPLE_LATE, read it after lowering TCK */
+
+  unsigned char i, d;
+  unsigned char lc=c;
+
+  for(i=0;i<8;i++)
+  {
+    if(SamplePoint == TDO_SAMPLE_LATE)
+    {
+      if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; IOE&=~0x08;
+      lc=((IOE&0x20)<<2)|(lc>>1);
+    }
+    else
+    {
+      for(d=SamplePoint;d;d--);
+      d = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=d|(lc>>1); IOE&=~0x08;
+    };
+  };
+
+  return lc;
+}
+
 unsigned char ProgIO_ShiftInOut(unsigned char c)
 {
   /* Shift out byte C, shift in from TDO:
@@ -136,6 +193,8 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
   unsigned char carry;
   unsigned char lc=c;
 
+  if(SamplePoint) return ShiftInOut_Slow(c);
+
   carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
   carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
   carry = (IOE&0x20)<<2; if(lc&1) IOE|=0x40; else IOE&=~0x40; IOE|=0x08; lc=carry|(lc>>1); IOE&=~0x08;
@@ -149,4 +208,21 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
   return lc;
 }
 
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  /* Give 4 TCK cycles with TMS from v.0, TDI from v.1, then v shifted
+   * right by two each time; return TDO as read before each rising edge
+   * in bits 0..3 */
+
+  unsigned char i, r;
+
+  for(i=0,r=0;i<4;i++,v>>=2)
+  {
+    SetTMS(v&1); SetTDI(v&2);
+    if(IOE&0x20) r |= 1<<i;
+    IOE|=0x08; IOE&=~0x08;
+  };
+
+  return r;
+}
 
@@ -16,6 +16,11 @@
  *-----------------------------------------------------------------------------
  */
 
+#ifdef hw_xpcu
+#define XPCU_PREFIX XpcuX
+#include "xpcu.h"
+#endif
+
 #include "delay.h"
 #include "syncdelay.h"
 #include "hardware.h"
@@ -31,10 +36,10 @@
 #include "syncdelay.h"
 #include "eeprom.h"
 
-void ProgIO_Poll(void)    {}
+unsigned char ProgIO_Poll(void) { return 1; }
 void ProgIO_Enable(void)  {}
-void ProgiO_Disable(void) {}
-void ProgiO_Deinit(void)  {}
+void ProgIO_Disable(void) {}
+void ProgIO_Deinit(void)  {}
 
 static unsigned char curios;
 
@@ -158,14 +163,19 @@ void ProgIO_Set_State(unsigned char d)
 
 unsigned char ProgIO_Set_Get_State(unsigned char d)
 {
-  unsigned char x;
-
   /*
    * Set state of output pins (see above)
    */
 
   ProgIO_Set_State(d);
 
+  return ProgIO_Get_State();
+}
+
+unsigned char ProgIO_Get_State(void)
+{
+  unsigned char x;
+
   /* Read state of input pins:
    *
    * TDO => d.0
@@ -201,6 +211,25 @@ void ProgIO_ShiftOut(unsigned char c)
   curios = locios;
 }
 
+void ProgIO_ShiftOut_Block(unsigned char n)
+{
+  /* Shift out n bytes, fetched through autopointer 1 */
+
+  while(n--) ProgIO_ShiftOut(XAUTODAT1);
+}
+
+static unsigned char SamplePoint; /* see ProgIO_Set_Sample_Point() */
+
+void ProgIO_Set_Sample_Point(unsigned char s)
+{
+  SamplePoint = s;
+}
+
+unsigned char ProgIO_Set_Adaptive(unsigned char t)
+{
+  (void)t; /* no RTCK input */
+  return 0;
+}
 
 unsigned char ProgIO_ShiftInOut(unsigned char c)
 {
@@ -211,10 +240,15 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
   {
     unsigned char t;
 
-    IOC = 0x41;
-    while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLX;
-    while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLNOX;
-    if(t & 1) n |= r;
+    if(SamplePoint != TDO_SAMPLE_LATE)
+    {
+      for(t=SamplePoint;t;t--);
+
+      IOC = 0x41;
+      while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLX;
+      while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLNOX;
+      if(t & 1) n |= r;
+    };
 
     IOC = 0x81;
     t = locios;
@@ -222,12 +256,50 @@ unsigned char ProgIO_ShiftInOut(unsigned char c)
 
     SetPins(t);
     SetPins(t|0x40);
-    r <<= 1;
     SetPins(t);
+
+    if(SamplePoint == TDO_SAMPLE_LATE)
+    {
+      IOC = 0x41;
+      while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLX;
+      while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLNOX;
+      if(t & 1) n |= r;
+    };
+
+    r <<= 1;
   };
 
   curios = locios;
   return n;
 }
 
+unsigned char ProgIO_Vector(unsigned char v)
+{
+  /* Give 4 TCK cycles with TMS from v.0, TDI from v.1, then v shifted
+   * right by two each time; return TDO as read before each rising edge
+   * in bits 0..3 */
+
+  unsigned char i, r, t;
+  unsigned char locios = curios & ~0x70;
+
+  for(i=0,r=0;i<4;i++,v>>=2)
+  {
+    IOC = 0x41;
+    while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLX;
+    while(!(GPIFTRIG & 0x80)); t = XGPIFSGLDATLNOX;
+    if(t & 1) r |= 1<<i;
+
+    IOC = 0x81;
+    t = locios;
+    if(v & 1) t |= 0x20;
+    if(v & 2) t |= 0x10;
+
+    SetPins(t);
+    SetPins(t|0x40);
+    SetPins(t);
+  };
+
+  curios = t;
+  return r;
+}
 
@@ -0,0 +1,802 @@
+/*-----------------------------------------------------------------------------
+ * JTAG TAP controller state tracking and scans
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "fx2regs.h"
+#include "hardware.h"
+#include "usbjtag.h"
+#include "tap.h"
+
+//-----------------------------------------------------------------------------
+// Pin states, same encoding as in bit banging mode (see usbjtag.c):
+// TAP_PINS (tap.h) plus TCK/TMS/TDI as needed.
+
+#define TAP_TCK             bmBIT0
+#define TAP_TMS             bmBIT1
+#define TAP_TDI             bmBIT4
+
+// Next state after a TCK cycle with TMS low (low nibble) or high (high nibble)
+
+static code unsigned char tap_next[16] =
+{
+  0x01, 0x21, 0x93, 0x54, 0x54, 0x86, 0x76, 0x84,
+  0x21, 0x0A, 0xCB, 0xCB, 0xFD, 0xED, 0xFB, 0x21
+};
+
+// Bit t is set if the first TCK cycle on the shortest path from this
+// state to state t needs TMS high. No path is longer than 8 cycles.
+
+static code unsigned short tap_path[16] =
+{
+  0x0000, 0xFFFD, 0xFE03, 0xFFE7, 0xFFEF, 0xFF0F, 0xFFBF, 0xFF0F,
+  0xFEFD, 0x01FF, 0xF3FF, 0xF7FF, 0x87FF, 0xDFFF, 0x87FF, 0x7FFD
+};
+
+// Bit order reversed, for data sent MSB first
+
+static code unsigned char tap_reverse[256] =
+{
+  0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0,
+  0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+  0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8,
+  0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+  0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4,
+  0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+  0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC,
+  0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+  0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2,
+  0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+  0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA,
+  0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+  0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6,
+  0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+  0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE,
+  0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+  0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1,
+  0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+  0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9,
+  0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+  0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5,
+  0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+  0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED,
+  0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+  0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3,
+  0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+  0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB,
+  0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+  0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7,
+  0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+  0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF,
+  0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF
+};
+
+static unsigned char tap_state;
+static unsigned char tap_end;
+static unsigned char tap_capture;
+static unsigned char tap_msb_first;
+static unsigned char tap_ir;
+static xdata unsigned long tap_bits;
+static xdata unsigned long tap_total;
+static xdata unsigned long tap_count;
+
+// Chain descriptor: per device, IR length and bypass code (4 bytes, LSB
+// first). Device 0 is the one nearest to TDO.
+
+#define TAP_CHAIN_ENTRY     5
+
+static xdata unsigned char tap_chain[TAP_CHAIN_MAX*TAP_CHAIN_ENTRY];
+static xdata unsigned char tap_chain_len;   /* devices announced */
+static xdata unsigned char tap_chain_pos;   /* descriptor bytes received */
+static unsigned char tap_devices;           /* devices in valid descriptor */
+static unsigned char tap_target;            /* device addressed by scans */
+
+// Selective capture: bit ranges (start, end exclusive) to return from the
+// next scan with TAP_CAPTURE, packed into tap_pack_byte
+
+static xdata unsigned char tap_range_raw[TAP_RANGES_MAX*4];
+static xdata unsigned long tap_range_start[TAP_RANGES_MAX];
+static xdata unsigned long tap_range_end[TAP_RANGES_MAX];
+static xdata unsigned char tap_range_pos;   /* raw bytes received */
+static xdata unsigned char tap_range_count; /* ranges announced */
+static unsigned char tap_ranges;            /* for the next scan */
+static unsigned char tap_ranges_active;     /* for the current scan */
+static unsigned char tap_range_next;        /* first range not yet passed */
+static unsigned char tap_pack_byte;
+static unsigned char tap_pack_bits;
+
+// Added to the end state of internal scans (sample) that capture all bits
+// and leave the ranges to the next scan requested by the host
+
+#define TAP_ALL_BITS        0x20
+
+// MSB first data, bit-reversed for ProgIO_ShiftOut_Block()
+
+#define TAP_BLOCK_LEN       64
+static xdata unsigned char tap_block[TAP_BLOCK_LEN];
+
+// Vectors of TMS/TDI pairs
+
+static xdata unsigned short tap_vector_clocks;
+static unsigned char tap_vector_capture;
+
+// Boundary scan sampling
+
+static xdata unsigned short tap_sample_bits;
+static xdata unsigned short tap_sample_count;
+static xdata unsigned short tap_sample_frame;
+static unsigned char tap_sample_flags;
+
+// Polling a register until it matches: TDI, mask and value, each one byte
+// per 8 bits, then TDO of the last scan
+
+static xdata unsigned char tap_poll_buf[3*TAP_POLL_BYTES];
+static xdata unsigned char tap_poll_tdo[TAP_POLL_BYTES];
+static xdata unsigned char tap_poll_pos;
+static xdata unsigned short tap_poll_count;
+static xdata unsigned short tap_poll_scans;
+static xdata unsigned short tap_poll_ticks;
+static xdata unsigned short tap_poll_start;
+static unsigned char tap_poll_bits;
+static unsigned char tap_poll_ir;
+static unsigned char tap_poll_end;
+
+//-----------------------------------------------------------------------------
+
+void tap_init(void)
+{
+  tap_state = TAP_RESET;
+  tap_bits = 0;
+  tap_count = 0;
+  tap_devices = 0;
+  tap_target = TAP_CHAIN_ALL;
+}
+
+void tap_clock(unsigned char tms)
+{
+  if(tms)
+    tap_state = tap_next[tap_state] >> 4;
+  else
+    tap_state = tap_next[tap_state] & 0x0F;
+}
+
+static void tap_step(unsigned char tms)
+{
+  unsigned char p = tms ? (TAP_PINS|TAP_TMS) : TAP_PINS;
+
+  ProgIO_Set_State(p);
+  ProgIO_Set_State(p|TAP_TCK);
+  ProgIO_Set_State(p);
+
+  tap_clock(tms);
+}
+
+void tap_goto(unsigned char s)
+{
+  unsigned char k;
+
+  s &= 0x0F;
+
+  if(s == TAP_RESET)
+  {
+    for(k=0;k<5;k++) tap_step(1);
+    return;
+  };
+
+  while(tap_state != s) tap_step((tap_path[tap_state] >> s) & 1);
+}
+
+unsigned char tap_stable(unsigned char s)
+{
+  s &= 0x0F;
+
+  return s == TAP_RESET || s == TAP_IDLE || s == TAP_DRPAUSE || s == TAP_IRPAUSE;
+}
+
+unsigned char tap_abort(void)
+{
+  /* A scan cut short is left right away, without its remaining bits, and
+     ends as it would have; a TAP left in an unstable end state (between
+     snapshots of a sampling job) is moved on to Run-Test/Idle. Counts of
+     vectors and runtest cycles are dropped. */
+
+  unsigned char moved = 0;
+
+  if(tap_bits > 0)
+  {
+    tap_step(1); // Shift-xR to Exit1-xR
+    tap_bits = 0;
+    tap_goto(tap_end);
+    moved = 1;
+  };
+
+  if(tap_state == tap_end && !tap_stable(tap_state))
+  {
+    tap_goto(TAP_IDLE);
+    moved = 1;
+  };
+
+  tap_count = 0;
+  tap_vector_clocks = 0;
+  tap_ranges_active = 0;
+  tap_pack_byte = 0;
+  tap_pack_bits = 0;
+
+  return moved;
+}
+
+static unsigned char tap_bit(unsigned char p)
+{
+  /* One TCK cycle with TMS/TDI from p, returns TDO read before it */
+
+  unsigned char r = ProgIO_Set_Get_State(p) & 1;
+
+  ProgIO_Set_State(p|TAP_TCK);
+  ProgIO_Set_State(p);
+
+  return r;
+}
+
+//-----------------------------------------------------------------------------
+
+void tap_ranges_begin(unsigned char n)
+{
+  tap_ranges = 0;
+  tap_range_count = (n > TAP_RANGES_MAX) ? TAP_RANGES_MAX : n;
+  tap_range_pos = 0;
+}
+
+void tap_ranges_data(unsigned short n)
+{
+  while(n--)
+  {
+    unsigned char d = XAUTODAT1;
+    if(tap_range_pos < tap_range_count*4) tap_range_raw[tap_range_pos++] = d;
+  };
+}
+
+void tap_ranges_end(void)
+{
+  unsigned char k;
+  xdata unsigned char *p = tap_range_raw;
+
+  for(k=0; k<tap_range_count; k++, p+=4)
+  {
+    tap_range_start[k] = p[0] | ((unsigned short)p[1] << 8);
+    tap_range_end[k] = tap_range_start[k] + (p[2] | ((unsigned short)p[3] << 8));
+  };
+
+  tap_ranges = tap_range_count;
+}
+
+//-----------------------------------------------------------------------------
+
+void tap_chain_begin(unsigned char n)
+{
+  tap_devices = 0;
+  tap_chain_len = (n > TAP_CHAIN_MAX) ? TAP_CHAIN_MAX : n;
+  tap_chain_pos = 0;
+}
+
+void tap_chain_data(unsigned short n)
+{
+  while(n--)
+  {
+    unsigned char d = XAUTODAT1;
+
+    if(tap_chain_pos < tap_chain_len*TAP_CHAIN_ENTRY)
+    {
+      /* IR length must be 1..32 */
+
+      if(tap_chain_pos % TAP_CHAIN_ENTRY == 0)
+      {
+        if(d < 1) d = 1;
+        if(d > 32) d = 32;
+      };
+
+      tap_chain[tap_chain_pos++] = d;
+    };
+  };
+}
+
+void tap_chain_end(void)
+{
+  if(tap_chain_pos == tap_chain_len*TAP_CHAIN_ENTRY) tap_devices = tap_chain_len;
+}
+
+void tap_select(unsigned char k)
+{
+  tap_target = k;
+}
+
+void tap_context_save(xdata unsigned char *p)
+{
+  unsigned char k;
+
+  p[0] = tap_state;
+  p[1] = tap_devices;
+  p[2] = tap_target;
+  for(k=0;k<TAP_CHAIN_MAX*TAP_CHAIN_ENTRY;k++) p[3+k] = tap_chain[k];
+}
+
+void tap_context_load(xdata unsigned char *p)
+{
+  unsigned char k;
+
+  tap_state = p[0];
+  tap_devices = p[1];
+  tap_target = p[2];
+  for(k=0;k<TAP_CHAIN_MAX*TAP_CHAIN_ENTRY;k++) tap_chain[k] = p[3+k];
+}
+
+static unsigned char tap_padded(void)
+{
+  /* Nonzero if the chain is known and a single device is addressed */
+
+  return tap_target < tap_devices;
+}
+
+static void tap_pad(unsigned char first, unsigned char last, unsigned char exit)
+{
+  /* Pad for devices first..last-1: their bypass code in an IR scan, a
+     single bit in a DR scan. With exit, TMS goes high with the final bit. */
+
+  unsigned char k, i, n, p;
+
+  for(k=first;k<last;k++)
+  {
+    xdata unsigned char *c = &tap_chain[k*TAP_CHAIN_ENTRY];
+
+    n = tap_ir ? c[0] : 1;
+
+    for(i=0;i<n;i++)
+    {
+      p = TAP_PINS;
+      if(tap_ir && (c[1+(i>>3)] & (1<<(i&7)))) p |= TAP_TDI;
+      if(exit && k == last-1 && i == n-1) p |= TAP_TMS;
+      tap_bit(p);
+    };
+  };
+}
+
+//-----------------------------------------------------------------------------
+// Scans use the byte shift kernels while TMS stays low. The last (up to 8)
+// bits are sent one by one, to raise TMS with the final bit. If a single
+// device is addressed, the bits for the devices between it and TDO are
+// shifted first, those for the devices between it and TDI last.
+
+void tap_scan_begin(unsigned char ir, unsigned long bits, unsigned char end)
+{
+  tap_goto(ir ? TAP_IRSHIFT : TAP_DRSHIFT);
+
+  tap_ir = ir;
+  tap_bits = bits;
+  tap_total = bits;
+  tap_end = end & 0x0F;
+  tap_capture = end & TAP_CAPTURE;
+  tap_msb_first = end & TAP_MSB_FIRST;
+
+  tap_ranges_active = 0;
+  if(tap_capture && !(end & TAP_ALL_BITS))
+  {
+    tap_ranges_active = tap_ranges;
+    tap_ranges = 0;
+    tap_range_next = 0;
+    tap_pack_bits = 0;
+  };
+
+  ProgIO_Set_State(TAP_PINS);
+
+  if(tap_padded()) tap_pad(0, tap_target, 0);
+
+  if(bits == 0) tap_goto(tap_end);
+}
+
+static unsigned char tap_scan_last(unsigned char d)
+{
+  /* Returns the TDO bits, in the same positions as d */
+
+  unsigned char i, m, p, r;
+  unsigned char post = tap_padded() && tap_target+1 < tap_devices;
+
+  for(i=tap_bits,m=1,r=0; i>0; i--,m<<=1)
+  {
+    p = TAP_PINS;
+    if(d & m) p |= TAP_TDI;
+    if(i == 1 && !post) p |= TAP_TMS;
+
+    if(tap_bit(p)) r |= m;
+  };
+
+  if(post) tap_pad(tap_target+1, tap_devices, 1);
+
+  tap_clock(1); // Shift-xR to Exit1-xR
+  tap_bits = 0;
+
+  tap_goto(tap_end);
+
+  return r;
+}
+
+static unsigned char tap_range_hit(unsigned long pos, unsigned char n)
+{
+  /* Nonzero if any of the n bits from pos is in a range */
+
+  while(tap_range_next < tap_ranges_active
+        && tap_range_end[tap_range_next] <= pos) tap_range_next++;
+
+  return tap_range_next < tap_ranges_active
+         && tap_range_start[tap_range_next] < pos + n;
+}
+
+static void tap_pack_bit(unsigned char b)
+{
+  if(b) tap_pack_byte |= 1 << tap_pack_bits;
+  if(++tap_pack_bits == 8)
+  {
+    OutputByte(tap_pack_byte);
+    tap_pack_byte = 0;
+    tap_pack_bits = 0;
+  };
+}
+
+static void tap_pack_flush(void)
+{
+  /* Rest of the last byte, padded with zeroes */
+
+  if(tap_pack_bits > 0)
+  {
+    OutputByte(tap_pack_byte);
+    tap_pack_byte = 0;
+    tap_pack_bits = 0;
+  };
+}
+
+static void tap_pack(unsigned char r, unsigned long pos, unsigned char n)
+{
+  /* Append those of the n bits in r (from pos) that are in a range */
+
+  unsigned char i;
+
+  for(i=0; i<n; i++, pos++, r>>=1)
+  {
+    if(tap_range_hit(pos, 1)) tap_pack_bit(r & 1);
+  };
+}
+
+void tap_scan_byte(unsigned char d)
+{
+  unsigned char r, n, capture;
+  unsigned long pos;
+
+  if(tap_bits == 0) return; /* more data than bits */
+
+  if(tap_msb_first) d = tap_reverse[d];
+
+  n = (tap_bits > 8) ? 8 : tap_bits;
+  pos = tap_total - tap_bits;
+
+  capture = tap_capture;
+  if(tap_ranges_active) capture = tap_range_hit(pos, n);
+
+  if(tap_bits > 8)
+  {
+    tap_bits -= 8;
+    if(!capture)
+    {
+      ProgIO_ShiftOut(d);
+      return;
+    };
+    r = ProgIO_ShiftInOut(d);
+  }
+  else
+  {
+    r = tap_scan_last(d);
+  };
+
+  if(tap_ranges_active)
+  {
+    if(capture) tap_pack(r, pos, n);
+    if(tap_bits == 0) tap_pack_flush();
+  }
+  else if(tap_capture)
+  {
+    OutputByte(tap_msb_first ? tap_reverse[r] : r);
+  };
+}
+
+static void tap_block_reversed(unsigned char k)
+{
+  /* Shift out k (up to TAP_BLOCK_LEN) bytes from XAUTODAT1 MSB first: a
+     bit-reversed copy is shifted, then autopointer 1 continues after the
+     bytes taken (which are left as they were, they might be a macro) */
+
+  unsigned char i, h, l;
+
+  for(i=0;i<k;i++) tap_block[i] = tap_reverse[XAUTODAT1];
+
+  h = APTR1H;
+  l = APTR1L;
+  APTR1H = (unsigned short)tap_block >> 8;
+  APTR1L = (unsigned short)tap_block & 0xFF;
+
+  ProgIO_ShiftOut_Block(k);
+
+  APTR1H = h;
+  APTR1L = l;
+}
+
+void tap_scan_data(unsigned short n)
+{
+  /* TDI data at XAUTODAT1. With TAP_CAPTURE, there's one byte of output
+     per byte of input, so the caller must leave space for n. */
+
+  while(n > 0)
+  {
+    if(tap_bits > 8 && !tap_capture)
+    {
+      unsigned long m = (tap_bits - 1) >> 3; /* all but the last byte */
+      unsigned char k;
+
+      if(m > n) m = n;
+      if(m > 0xFF) m = 0xFF;
+      if(tap_msb_first && m > TAP_BLOCK_LEN) m = TAP_BLOCK_LEN;
+      k = m;
+
+      n -= k;
+      tap_bits -= (unsigned short)k << 3;
+
+      if(tap_msb_first)
+        tap_block_reversed(k);
+      else
+        ProgIO_ShiftOut_Block(k);
+    }
+    else
+    {
+      tap_scan_byte(XAUTODAT1);
+      n--;
+    };
+  };
+}
+
+unsigned char tap_shift(unsigned char ir, unsigned char bits, unsigned char d, unsigned char end)
+{
+  tap_scan_begin(ir, bits, end & 0x0F);
+
+  if(bits == 0) return 0;
+
+  return tap_scan_last(d);
+}
+
+//-----------------------------------------------------------------------------
+// Vectors: ProgIO_Vector() for whole bytes, tap_bit() for the rest
+
+void tap_vector_begin(unsigned short clocks, unsigned char capture)
+{
+  tap_vector_clocks = clocks;
+  tap_vector_capture = capture;
+  tap_pack_byte = 0;
+  tap_pack_bits = 0;
+
+  ProgIO_Set_State(TAP_PINS);
+}
+
+void tap_vector_data(unsigned short n)
+{
+  while(n--)
+  {
+    unsigned char d = XAUTODAT1;
+    unsigned char i, k, r;
+
+    if(tap_vector_clocks == 0) continue; /* more data than clocks */
+
+    if(tap_vector_clocks >= 4)
+    {
+      k = 4;
+      r = ProgIO_Vector(d);
+    }
+    else
+    {
+      k = tap_vector_clocks;
+      for(i=0,r=0; i<k; i++)
+      {
+        unsigned char p = TAP_PINS;
+        if(d & (1 << 2*i)) p |= TAP_TMS;
+        if(d & (2 << 2*i)) p |= TAP_TDI;
+        if(tap_bit(p)) r |= 1 << i;
+      };
+    };
+
+    tap_vector_clocks -= k;
+
+    for(i=0; i<k; i++, d>>=2, r>>=1)
+    {
+      tap_clock(d & 1);
+      if(tap_vector_capture) tap_pack_bit(r & 1);
+    };
+
+    if(tap_vector_clocks == 0)
+    {
+      if(tap_vector_capture) tap_pack_flush();
+      ProgIO_Set_State(TAP_PINS);
+    };
+  };
+}
+
+//-----------------------------------------------------------------------------
+// Repeated DR scans, e.g. with SAMPLE/PRELOAD in IR. Each scan ends in
+// Update-DR, so the next one passes through Capture-DR again. Output is
+// produced in parts as space permits; a scan started is always finished.
+
+void tap_sample_begin(unsigned short bits, unsigned short count, unsigned char flags)
+{
+  tap_sample_bits = bits;
+  tap_sample_count = count;
+  tap_sample_frame = 0;
+  tap_sample_flags = flags;
+  tap_bits = 0;
+}
+
+unsigned char tap_sample_poll(void)
+{
+  unsigned char n = OutputSpace();
+
+  if(n > 0x3E) n = 0x3E;
+
+  if(tap_bits == 0)
+  {
+    /* Start next snapshot or stop */
+
+    if(tap_sample_bits == 0 || (tap_sample_frame == tap_sample_count && tap_sample_count != 0))
+    {
+      tap_goto(TAP_IDLE);
+      return 1;
+    };
+
+    if(n < 2) return 0;
+
+    if(tap_sample_flags & TAP_SAMPLE_COUNTER)
+    {
+      OutputByte(tap_sample_frame);
+      OutputByte(tap_sample_frame >> 8);
+      n -= 2;
+    };
+
+    tap_sample_frame++;
+    tap_scan_begin(0, tap_sample_bits, TAP_DRUPDATE|TAP_CAPTURE|TAP_ALL_BITS);
+  };
+
+  for(; n>0 && tap_bits>0; n--)
+  {
+    if(tap_bits > 8)
+    {
+      OutputByte(ProgIO_ShiftInOut(0));
+      tap_bits -= 8;
+    }
+    else
+    {
+      OutputByte(tap_scan_last(0));
+    };
+  };
+
+  return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Poll: one scan per call, so that the job can be aborted at any time.
+
+void tap_poll_begin(unsigned char ir, unsigned char bits, unsigned char end,
+                    unsigned short count, unsigned short ticks)
+{
+  tap_poll_ir = ir;
+  tap_poll_bits = bits;
+  tap_poll_end = end & 0x0F;
+  tap_poll_count = count;
+  tap_poll_ticks = ticks;
+  tap_poll_scans = 0;
+  tap_poll_pos = 0;
+}
+
+void tap_poll_data(unsigned short n)
+{
+  while(n--)
+  {
+    unsigned char d = XAUTODAT1;
+    if(tap_poll_pos < sizeof(tap_poll_buf)) tap_poll_buf[tap_poll_pos++] = d;
+  };
+}
+
+unsigned char tap_poll_poll(void)
+{
+  unsigned char i, k, match;
+
+  k = (tap_poll_bits + 7) >> 3;
+
+  if(OutputSpace() < k+2) return 0;
+
+  if(tap_poll_scans == 0) tap_poll_start = TickCount();
+
+  tap_scan_begin(tap_poll_ir, tap_poll_bits, tap_poll_end);
+
+  for(i=0,match=1; i<k; i++)
+  {
+    unsigned char r, d = tap_poll_buf[i];
+
+    if(tap_bits > 8)
+    {
+      r = ProgIO_ShiftInOut(d);
+      tap_bits -= 8;
+    }
+    else
+    {
+      r = tap_scan_last(d);
+    };
+
+    tap_poll_tdo[i] = r;
+    if((r & tap_poll_buf[k+i]) != tap_poll_buf[2*k+i]) match = 0;
+  };
+
+  if(tap_poll_scans != 0xFFFF) tap_poll_scans++; // saturate, don't wrap
+
+  if(!match
+     && (tap_poll_count == 0 || tap_poll_scans != tap_poll_count)
+     && (tap_poll_ticks == 0 ||
+         (unsigned short)(TickCount() - tap_poll_start) < tap_poll_ticks))
+  {
+    return 0;
+  };
+
+  for(i=0; i<k; i++) OutputByte(tap_poll_tdo[i]);
+  OutputByte(tap_poll_scans);
+  OutputByte(tap_poll_scans >> 8);
+
+  return 1;
+}
+
+//-----------------------------------------------------------------------------
+
+void tap_runtest_begin(unsigned char s, unsigned long n)
+{
+  tap_goto(s);
+  tap_count = n;
+
+  ProgIO_Set_State((tap_state == TAP_RESET) ? (TAP_PINS|TAP_TMS) : TAP_PINS);
+}
+
+unsigned char tap_runtest_poll(void)
+{
+  /* Whole bytes through the shift kernel (TMS unchanged), at most 2040
+     cycles per call, then the rest one by one */
+
+  if(tap_count >= 8)
+  {
+    unsigned char k = (tap_count >= 0xFF*8) ? 0xFF : (tap_count >> 3);
+
+    tap_count -= (unsigned short)k << 3;
+    while(k--) ProgIO_ShiftOut(0);
+
+    if(tap_count >= 8) return 0;
+  };
+
+  while(tap_count > 0)
+  {
+    tap_step(tap_state == TAP_RESET);
+    tap_count--;
+  };
+
+  return 1;
+}
+
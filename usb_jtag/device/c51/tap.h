@@ -0,0 +1,144 @@
+/*-----------------------------------------------------------------------------
+ * JTAG TAP controller state tracking and scans
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _TAP_H
+#define _TAP_H 1
+
+/* TAP controller states, numbered as in XSVF */
+
+#define TAP_RESET       0x00
+#define TAP_IDLE        0x01
+#define TAP_DRSELECT    0x02
+#define TAP_DRCAPTURE   0x03
+#define TAP_DRSHIFT     0x04
+#define TAP_DREXIT1     0x05
+#define TAP_DRPAUSE     0x06
+#define TAP_DREXIT2     0x07
+#define TAP_DRUPDATE    0x08
+#define TAP_IRSELECT    0x09
+#define TAP_IRCAPTURE   0x0A
+#define TAP_IRSHIFT     0x0B
+#define TAP_IREXIT1     0x0C
+#define TAP_IRPAUSE     0x0D
+#define TAP_IREXIT2     0x0E
+#define TAP_IRUPDATE    0x0F
+
+/* Added to the end state of a scan to return TDO to the host */
+#define TAP_CAPTURE     0x80
+
+/* Added to the end state of a scan to send (and return) bytes MSB first */
+#define TAP_MSB_FIRST   0x40
+
+/* Pin state (as in bit banging mode) left after TAP commands: TCK, TMS
+   and TDI low, nCE low, nCS high, output enabled */
+#define TAP_PINS        (bmBIT3|bmBIT5)
+
+/* Assume the TAP is in Test-Logic-Reset (no clocks are given) */
+extern void tap_init(void);
+
+/* Follow a TCK cycle given by someone else with TMS as given */
+extern void tap_clock(unsigned char tms);
+
+/* Move to state s; TAP_RESET always takes five TCK cycles with TMS high */
+extern void tap_goto(unsigned char s);
+
+/* Nonzero for the stable states (Test-Logic-Reset, Run-Test/Idle and the
+   Pause states), the only ones allowed as end state of scans and runtest */
+extern unsigned char tap_stable(unsigned char s);
+
+/* Clean up after a scan, sampling, vector or runtest command or job was
+   aborted: a scan in progress is ended without its remaining bits, and
+   the TAP is left in a stable state. Returns nonzero if TCK was given
+   (pins are then as TAP_PINS). */
+extern unsigned char tap_abort(void);
+
+/* Shift bits through IR (ir != 0) or DR, with TDI data passed to
+   tap_scan_data() (n bytes at XAUTODAT1) or tap_scan_byte(), then move
+   to end state (plus TAP_CAPTURE, TAP_MSB_FIRST) */
+extern void tap_scan_begin(unsigned char ir, unsigned long bits, unsigned char end);
+extern void tap_scan_data(unsigned short n);
+extern void tap_scan_byte(unsigned char d);
+
+/* Shift up to 8 bits from d (LSB first) through IR or DR, then move to
+   end state; returns the bits read from TDO */
+extern unsigned char tap_shift(unsigned char ir, unsigned char bits, unsigned char d, unsigned char end);
+
+/* Give TCK cycles with TMS/TDI from bytes passed to tap_vector_data(), 4
+   cycles per byte with (TMS, TDI) in bits (0, 1), (2, 3), ... If capture
+   is nonzero, TDO is sent to the host, 8 cycles per byte (LSB first) and
+   the last byte padded with zeroes. The TAP state is followed. */
+extern void tap_vector_begin(unsigned short clocks, unsigned char capture);
+extern void tap_vector_data(unsigned short n);
+
+/* Bit ranges for the next scan with TAP_CAPTURE: only the TDO bits in
+   these are sent to the host, packed LSB first (in the order shifted) and
+   the last byte padded with zeroes. n ranges (up to TAP_RANGES_MAX, in
+   ascending order and not overlapping), 4 bytes each passed to
+   tap_ranges_data(): first bit and number of bits (16 bit each, LSB
+   first). Bytes without any bit in a range are shifted without reading. */
+#define TAP_RANGES_MAX  8
+extern void tap_ranges_begin(unsigned char n);
+extern void tap_ranges_data(unsigned short n);
+extern void tap_ranges_end(void);
+
+/* Chain descriptor for n devices (up to TAP_CHAIN_MAX), starting with the
+   one nearest to TDO, 5 bytes each passed to tap_chain_data(): IR length
+   and bypass code (LSB first). tap_select() addresses a single device in
+   following scans; the others are padded with their bypass code (IR) or
+   a single bit (DR). TAP_CHAIN_ALL addresses the whole chain. */
+#define TAP_CHAIN_MAX   8
+#define TAP_CHAIN_ALL   0xFF
+extern void tap_chain_begin(unsigned char n);
+extern void tap_chain_data(unsigned short n);
+extern void tap_chain_end(void);
+extern void tap_select(unsigned char k);
+
+/* Save or restore TAP state and chain descriptor (TAP_CONTEXT_LEN bytes),
+   for adapters that switch between more than one JTAG chain */
+#define TAP_CONTEXT_LEN (3+TAP_CHAIN_MAX*5)
+extern void tap_context_save(xdata unsigned char *p);
+extern void tap_context_load(xdata unsigned char *p);
+
+/* Repeat DR scans of the given length, count times (0: until stopped
+   by aborting the job), with TDO sent to the host and optionally each
+   preceded by a 16 bit frame counter. tap_sample_poll() has to be called
+   until it returns nonzero */
+#define TAP_SAMPLE_COUNTER 0x01
+extern void tap_sample_begin(unsigned short bits, unsigned short count, unsigned char flags);
+extern unsigned char tap_sample_poll(void);
+
+/* Repeat a scan of up to 32 bits through IR or DR, ending in state end,
+   until (TDO & mask) == value, count scans were done or ticks (10ms)
+   have passed (count or ticks 0: no limit). TDI, mask and value, (bits+7)/8
+   bytes each, are passed to tap_poll_data(). tap_poll_poll() has to be
+   called until it returns nonzero; then the TDO of the last scan and the
+   16 bit number of scans (saturating at 0xFFFF) have been sent to the
+   host. */
+#define TAP_POLL_BYTES  4
+extern void tap_poll_begin(unsigned char ir, unsigned char bits, unsigned char end,
+                           unsigned short count, unsigned short ticks);
+extern void tap_poll_data(unsigned short n);
+extern unsigned char tap_poll_poll(void);
+
+/* Move to stable state s and give n TCK cycles there. tap_runtest_poll()
+   has to be called until it returns nonzero */
+extern void tap_runtest_begin(unsigned char s, unsigned long n);
+extern unsigned char tap_runtest_poll(void);
+
+#endif /* _TAP_H */
+
@@ -21,6 +21,7 @@
 
 #include "isr.h"
 #include "timer.h"
+#include "sched.h"
 #include "delay.h"
 #include "fx2regs.h"
 #include "fx2utils.h"
@@ -32,6 +33,11 @@
 
 #include "eeprom.h"
 #include "hardware.h"
+#include "usbjtag.h"
+#include "epcs.h"
+#include "tap.h"
+#include "bootrom.h"
+#include "xcfg.h"
 
 //-----------------------------------------------------------------------------
 // Define USE_MOD256_OUTBUFFER:
@@ -50,109 +56,1203 @@ typedef bit BOOL;
 #define FALSE 0
 #define TRUE  1
 static BOOL Running;
+static BOOL Ready; // target ready, as reported by ProgIO_Poll()
+static BOOL PinsOwed; // LastState to be set once Ready, see SetPins()
 static BOOL WriteOnly;
 
 static BYTE ClockBytes;
 static WORD Pending;
 
+// Position in the EP2 packet being processed, so that processing can be
+// suspended (e.g. while a job runs or output space is short) and resumed.
+
+static BOOL RxBusy;
+static WORD RxLen;
+static WORD RxPos;
+
+// Priority channel (EP1 OUT, answers on EP8 IN), see PriorityChannel()
+
+#define PRI_GET_PINS      0x01
+#define PRI_GET_COUNTERS  0x02
+#define PRI_PAUSE         0x03
+#define PRI_RESUME        0x04
+#define PRI_ABORT         0x05
+
+static BYTE PriorityPos; // next command in EP1OUTBUF, see PriorityChannel()
+static BOOL Paused;
+static BYTE LastState; // last pin state set in bit banging mode
+static xdata unsigned long RxTotal;
+static xdata unsigned long TxTotal;
+
+// Vendor request to discard all queued data, see Flush()
+
+#define RQ_FLUSH          0xB0
+#define FLUSH_STATE       (bmBIT1|bmBIT3|bmBIT5)
+
+static BYTE FlushGeneration;
+
+// Vendor request to select how status packets are sent on EP1 IN
+
+#define RQ_KEEPALIVE      0xB1
+#define KEEPALIVE_FT245   0   // every 10ms and after data, as FT245BM does
+#define KEEPALIVE_QUIET   1   // only to end a transfer, when host asks
+
+static BYTE KeepaliveMode;
+static BOOL StatusOwed;        // last data packet was full size
+static volatile BOOL InRequested;  // host got NAK on EP1 IN
+
+// Vendor request to move the TDO sample point, see ProgIO_Set_Sample_Point()
+
+#define RQ_TDO_SAMPLE     0xB2
+
+// Vendor request for adaptive clocking (RTCK), see ProgIO_Set_Adaptive()
+
+#define RQ_ADAPTIVE       0xB6
+
+// Vendor request to switch between the JTAG chains of adapters that have
+// more than one (PROGIO_CHAINS), see SelectChain()
+
+#define RQ_CHAIN          0xB7
+
+static BYTE Chain;
+static xdata BYTE ChainPins[PROGIO_CHAINS];   // LastState of each chain
+static xdata BYTE ChainTap[PROGIO_CHAINS][TAP_CONTEXT_LEN];
+
+// Vendor requests for the FX2 boot EEPROM, as in Cypress' Vend_Ax/a3load
+
+#define RQ_BOOTROM        0xA2
+#define RQ_BOOTROM_SIZE   0xA5
+
+// Timer2 counts ticks (100 Hz) for the scheduler in fx2/sched.c, which
+// runs Keepalive() every tick from the main loop
+
+#define TICK_RELOAD       (65536 - 48000000/12/SCHED_HZ)
+
+static BOOL KeepaliveDue;
+
+// Time (us since usb_jtag_init) when each boot phase was reached, for the
+// vendor request RQ_BOOT_TIMES. 0xFFFFFFFF if not (yet) reached.
+
+#define RQ_BOOT_TIMES     0xB3
+
+// Input is decoded in chunks of at most PREEMPT_CHUNK payload bytes, and
+// decoding is suspended as soon as a setup packet is waiting, so that EP0
+// requests aren't held up by a long shift. How long a setup packet might
+// have waited is measured in main_loop() and read with RQ_SETUP_LATENCY.
+
+#define PREEMPT_CHUNK     64
+#define RQ_SETUP_LATENCY  0xB4
+
+static WORD SetupLatencyMax; // us, 0xFFFF: 20ms or more
+static WORD SetupCount;
+
+#define BOOT_INIT         0 // usb_jtag_init() done
+#define BOOT_HANDLERS     1 // ready to renumerate
+#define BOOT_RENUM        2 // reconnected to USB
+#define BOOT_SETUP        3 // first setup packet from host
+#define BOOT_POWER        4 // target ready (supply up)
+#define BOOT_RUNNING      5 // host started to use the FT245 emulation
+#define BOOT_PHASES       6
+
+static BYTE BootSeen;
+static xdata unsigned long BootTime[BOOT_PHASES];
+
 #ifdef USE_MOD256_OUTBUFFER
   static BYTE FirstDataInOutBuffer;
   static BYTE FirstFreeInOutBuffer;
+  static BYTE FrameHeader;
 #else
   static WORD FirstDataInOutBuffer;
   static WORD FirstFreeInOutBuffer;
+  static WORD FrameHeader;
 #endif
 
-#ifdef USE_MOD256_OUTBUFFER
-  /* Size of output buffer must be exactly 256 */
-  #define OUTBUFFER_LEN 0x100
-  /* Output buffer must begin at some address with lower 8 bits all zero */
-  xdata at 0xE000 BYTE OutBuffer[OUTBUFFER_LEN];
-#else
-  #define OUTBUFFER_LEN 0x200
-  static xdata BYTE OutBuffer[OUTBUFFER_LEN];
-#endif
+// Tagged readback (CMD_FRAME_BEGIN): output goes into frames of tag, length
+// and data, which are held back in OutBuffer (not counted in Pending) until
+// complete. Longer output is split into frames of FRAME_MAX bytes, all but
+// the last with FRAME_MORE in the length byte.
+
+#define FRAME_MAX         0x7F
+#define FRAME_MORE        0x80
+
+static BOOL FrameOpen;
+static BYTE FrameTag;
+static BYTE FrameLen;
+
+// Vendor request to add USB frame counter stamps (USBFRAMEL, USBFRAMEH,
+// MICROFRAME) to tagged frames and status packets, see Stamp()
+
+#define RQ_TIMESTAMPS     0xB5
+#define STAMP_FRAMES      bmBIT0 // receipt and completion in frame header
+#define STAMP_STATUS      bmBIT1 // in status packets, as frame STAMP_TAG
+#define STAMP_LEN         3
+#define STAMP_TAG         0xFF
+
+static BYTE Timestamps;
+static BOOL FrameStamped;
+static xdata BYTE RxStamp[STAMP_LEN];    // when current EP2 packet came
+static xdata BYTE FrameRxStamp[STAMP_LEN];
+
+#define FRAME_HEADER      (2 + 2*STAMP_LEN) // largest header
+
+//-----------------------------------------------------------------------------
+// Extended commands (see comment above usb_jtag_activity)
+
+#define CMD_ESCAPE        0x80 // byte shift of zero bytes, introduces ext. cmd
+#define CMD_MACRO         0xC0 // same with "Read bit", short for 0x80 0x19
+
+#define EXT_IDLE          0  // not within an extended command
+#define EXT_OPCODE        1  // escape seen, next byte is the opcode
+#define EXT_ARGS          2  // collecting argument bytes
+
+#define CMD_PS_CONFIG     0x01
+#define CMD_AS_READ       0x02
+#define CMD_AS_PROGRAM    0x03
+#define CMD_AS_ERASE      0x04
+#define CMD_AS_ERASE_BULK 0x05
+#define CMD_TAP_GOTO      0x10
+#define CMD_TAP_SCAN_IR   0x11
+#define CMD_TAP_SCAN_DR   0x12
+#define CMD_TAP_RUNTEST   0x13
+#define CMD_TAP_CHAIN     0x14
+#define CMD_TAP_SELECT    0x15
+#define CMD_TAP_SAMPLE    0x16
+#define CMD_XCFG          0x17
+#define CMD_MACRO_DEFINE  0x18
+#define CMD_MACRO_RUN     0x19
+#define CMD_TAP_POLL      0x1A
+#define CMD_WAIT          0x1B
+#define CMD_TAP_RANGES    0x1C
+#define CMD_FRAME_BEGIN   0x1D
+#define CMD_FRAME_END     0x1E
+#define CMD_VECTOR        0x1F
+
+static BYTE ExtState;
+static BYTE ExtCmd;
+static BYTE ExtArgLen;
+static BYTE ExtArgPos;
+static xdata BYTE ExtArg[8];
+
+// Payload that follows an extended command is consumed by an engine
+// selected through StreamMode, StreamBytes counts down to zero.
+
+#define STREAM_DISCARD 0 // drop the rest of the payload (e.g. after error)
+#define STREAM_PS      1 // passive serial configuration data
+#define STREAM_AS      2 // EPCS page program data
+#define STREAM_TAP     3 // TDI data for a scan
+#define STREAM_TAP_READ 4 // TDI data for a scan, with TDO sent to host
+#define STREAM_CHAIN   5 // JTAG chain descriptor
+#define STREAM_XCFG    6 // Xilinx .bit/.bin file for JTAG configuration
+#define STREAM_MACRO   7 // parameter offsets and body of a macro
+#define STREAM_POLL    8 // TDI, mask and value for polling
+#define STREAM_RANGES  9 // bit ranges for selective capture
+#define STREAM_VECTOR  10 // TMS/TDI pairs, 4 per byte
+#define STREAM_VECTOR_READ 11 // same, with TDO sent to host
+
+static unsigned long StreamBytes;
+static BYTE StreamMode;
+
+// Jobs run from usb_jtag_activity until they report completion. While a
+// job is active, no further input is processed.
+
+#define JOB_NONE       0
+#define JOB_EPCS       1 // epcs_poll() until done
+#define JOB_TAP        2 // tap_runtest_poll() until done
+#define JOB_SAMPLE     3 // tap_sample_poll() until done or aborted
+#define JOB_POLL       4 // tap_poll_poll() until match or limit
+#define JOB_WAIT       5 // WaitPoll() until the time has passed
+#define JOB_XCFG       6 // xcfg_init_poll() until INIT_B is high
+#define JOB_PS         7 // PSStartPoll() until nSTATUS is high
+
+static BYTE Job;
+
+// Macros: command sequences stored in xdata by CMD_MACRO_DEFINE and decoded
+// like EP2 input when invoked. Parameters given with the invocation are
+// written into the body at offsets given with the definition.
+
+#define MACRO_COUNT    8
+#define MACRO_SIZE     64
+#define MACRO_PARAMS   4
+
+static xdata BYTE MacroBody[MACRO_COUNT][MACRO_SIZE];
+static xdata BYTE MacroLen[MACRO_COUNT];
+static xdata BYTE MacroParams[MACRO_COUNT];
+static xdata BYTE MacroSlot[MACRO_COUNT][MACRO_PARAMS];
+
+static BYTE MacroDefined; // macro being defined through STREAM_MACRO
+static BYTE MacroFill;    // bytes of its definition received so far
+static WORD MacroPos;     // xdata address of next byte of running macro
+static WORD MacroEnd;     // MacroPos == MacroEnd: no macro running
+static BOOL MacroCalled;  // a macro was invoked from EP2 input
+
+// Passive serial configuration: pin states as for bit banging mode, i.e.
+// DCLK low, nCONFIG high, nCE low, nCS high, DATA0 low, output enabled.
+
+#define PS_IDLE        (bmBIT1|bmBIT3|bmBIT5)
+#define PS_NCONFIG     bmBIT1
+#define PS_NSTATUS     bmBIT1 // in result of ProgIO_Set_Get_State
+#define PS_CONF_DONE   bmBIT0 // in result of ProgIO_Set_Get_State
+#define PS_ERR_START   bmBIT7 // nSTATUS didn't go high after nCONFIG pulse
+#define PS_ERR_STREAM  bmBIT6 // nSTATUS went low while data was streamed
+#define PS_INIT_BYTES  32     // DCLK cycles/8 for device initialization
+#define PS_START_TICKS 2      // for nSTATUS to go high, see PSStartPoll()
+
+static BOOL PSReported;
+static BYTE PSTimer;          // scheduler slot of PSTimeout()
+static volatile BOOL PSTimedOut;
+
+#ifdef USE_MOD256_OUTBUFFER
+  /* Size of output buffer must be exactly 256 */
+  #define OUTBUFFER_LEN 0x100
+  /* Output buffer must begin at some address with lower 8 bits all zero */
+  xdata at 0xE000 BYTE OutBuffer[OUTBUFFER_LEN];
+#else
+  #define OUTBUFFER_LEN 0x200
+  static xdata BYTE OutBuffer[OUTBUFFER_LEN];
+#endif
+
+//-----------------------------------------------------------------------------
+
+static void Keepalive(void)
+{
+   KeepaliveDue = TRUE;
+}
+
+WORD TickCount(void)
+{
+   return sched_ticks();
+}
+
+static unsigned long Microseconds(void)
+{
+   WORD t;
+   BYTE h, l;
+
+   ET2 = 0;
+
+   do
+   {
+      h = TH2;
+      l = TL2;
+   } while(h != TH2);
+
+   t = sched_tick_count;
+
+   // Overflow not yet counted (e.g. interrupts still disabled at boot)
+
+   if(TF2 && h < 0x80) t++;
+
+   ET2 = 1;
+
+   return t * 10000UL + ((((WORD)h << 8) | l) - TICK_RELOAD) / 4;
+}
+
+static void BootPhase(BYTE k)
+{
+   if(BootSeen & (1 << k)) return;
+   BootSeen |= 1 << k;
+   BootTime[k] = Microseconds();
+}
+
+//-----------------------------------------------------------------------------
+// Waits in the command stream (CMD_WAIT) are timed with Timer0, free running
+// at CLKOUT/12 without interrupts. WaitPoll() must be called at least every
+// 16ms to see all overflows; if it isn't, the wait gets longer, not shorter.
+
+#define WAIT_COUNTS_PER_US 4
+
+static xdata unsigned long WaitLeft; // us
+static WORD WaitLast;
+static BYTE WaitFrac;
+
+static WORD Timer0(void)
+{
+   BYTE h, l;
+
+   do
+   {
+      h = TH0;
+      l = TL0;
+   } while(h != TH0);
+
+   return ((WORD)h << 8) | l;
+}
+
+static void WaitBegin(unsigned long us)
+{
+   WaitLeft = us;
+   WaitFrac = 0;
+   WaitLast = Timer0();
+}
+
+static BOOL WaitPoll(void)
+{
+   WORD now = Timer0();
+   unsigned long c = (WORD)(now - WaitLast) + WaitFrac;
+
+   WaitLast = now;
+   WaitFrac = c % WAIT_COUNTS_PER_US;
+   c /= WAIT_COUNTS_PER_US;
+
+   if(c >= WaitLeft) return TRUE;
+
+   WaitLeft -= c;
+   return FALSE;
+}
+
+//-----------------------------------------------------------------------------
+
+static void ArmEP2(void)
+{
+   BYTE k;
+
+   for(k=0;k<4;k++)
+   {
+      SYNCDELAY;
+      EP2BCL = 0x80; // arm EP2OUT by writing byte count w/skip.
+   };
+}
+
+void usb_jtag_init(void)              // Called once at startup
+{
+   BYTE k;
+
+   // Start Timer2 first, it's the time base for ProgIO_Init() and BootTime
+
+   sched_init();
+   KeepaliveDue = FALSE;
+   sched_every(1, Keepalive);
+   PSTimer = SCHED_NONE;
+
+   BootSeen = 0;
+   for(k=0;k<BOOT_PHASES;k++) BootTime[k] = 0xFFFFFFFF;
+
+   Running = FALSE;
+   Ready = FALSE;
+   PinsOwed = FALSE;
+   ClockBytes = 0;
+   Pending = 0;
+   WriteOnly = TRUE;
+   FirstDataInOutBuffer = 0;
+   FirstFreeInOutBuffer = 0;
+   FrameOpen = FALSE;
+   Timestamps = 0;
+   ExtState = EXT_IDLE;
+   StreamBytes = 0;
+   Job = JOB_NONE;
+   MacroPos = MacroEnd = 0;
+   for(k=0;k<MACRO_COUNT;k++) MacroLen[k] = MacroParams[k] = 0;
+   RxBusy = FALSE;
+   Paused = FALSE;
+   FlushGeneration = 0;
+   KeepaliveMode = KEEPALIVE_FT245;
+   StatusOwed = FALSE;
+   InRequested = FALSE;
+   LastState = 0;
+   RxTotal = 0;
+   TxTotal = 0;
+
+   ProgIO_Init();
+   ProgIO_Set_Sample_Point(0);
+   ProgIO_Set_Adaptive(0);
+   tap_init();
+
+   Chain = 0;
+   for(k=0;k<PROGIO_CHAINS;k++)
+   {
+      ChainPins[k] = 0;
+      tap_context_save(ChainTap[k]);
+   };
+
+   ProgIO_Enable();
+
+   CKCON = 0; // Default Clock
+
+   // Timer0 for CMD_WAIT: 16 bit, CLKOUT/12, no interrupt
+
+   TMOD = (TMOD & 0xF0) | 0x01;
+   TR0 = 1;
+
+   // Enable Autopointer
+
+   EXTACC = 1;  // Enable
+   APTR1FZ = 1; // Don't freeze
+   APTR2FZ = 1; // Don't freeze
+
+   // define endpoint configuration
+
+   FIFORESET = 0x80; SYNCDELAY;    // From now on, NAK all
+   REVCTL = 3; SYNCDELAY;          // Allow FW access to FIFO buffer
+
+   EP1OUTCFG  = 0xA0; SYNCDELAY;
+   EP1INCFG   = 0xA0; SYNCDELAY;
+
+   // EP2 is quad buffered, so the host can queue three more packets
+   // while one is being processed. This takes the buffers of EP4.
+
+   EP2FIFOCFG = 0x00; SYNCDELAY;
+   FIFORESET  = 0x02; SYNCDELAY;
+   EP2CFG     = 0xA0; SYNCDELAY;
+
+   EP4CFG     = 0x20; SYNCDELAY;   // Not valid
+
+   EP6FIFOCFG = 0x00; SYNCDELAY;
+   FIFORESET  = 0x06; SYNCDELAY;
+   EP6CFG     = 0xE2; SYNCDELAY;
+
+   EP8FIFOCFG = 0x00; SYNCDELAY;
+   FIFORESET  = 0x08; SYNCDELAY;
+   EP8CFG     = 0xE0; SYNCDELAY;
+
+   FIFORESET  = 0x00; SYNCDELAY;   // Restore normal behaviour
+   REVCTL = 0; SYNCDELAY;          // Reset FW access to FIFO buffer
+
+   // out endpoints do not come up armed
+   // EP2 is quad buffered, so we must write dummy byte counts four times
+
+   ArmEP2();
+
+   PriorityPos = 0;
+   EP1OUTBC = 0; // arm EP1OUT (priority channel)
+}
+
+static void PutByte(BYTE d)
+{
+#ifdef USE_MOD256_OUTBUFFER
+   OutBuffer[FirstFreeInOutBuffer] = d;
+   FirstFreeInOutBuffer = ( FirstFreeInOutBuffer + 1 ) & 0xFF;
+#else
+   OutBuffer[FirstFreeInOutBuffer++] = d;
+   if(FirstFreeInOutBuffer >= OUTBUFFER_LEN) FirstFreeInOutBuffer = 0;
+#endif
+}
+
+static void Stamp(xdata BYTE *p)
+{
+   do
+   {
+      p[0] = USBFRAMEL;
+      p[1] = USBFRAMEH;
+      p[2] = MICROFRAME;
+   } while(p[0] != USBFRAMEL);
+}
+
+static void FrameBegin(BYTE tag)
+{
+   BYTE k;
+
+   FrameTag = tag;
+   FrameLen = 0;
+   FrameHeader = FirstFreeInOutBuffer;
+   FrameOpen = TRUE;
+
+   PutByte(tag);
+   PutByte(0); // length, set by FrameClose()
+
+   if(FrameStamped)
+   {
+      for(k=0;k<STAMP_LEN;k++) PutByte(FrameRxStamp[k]);
+      for(k=0;k<STAMP_LEN;k++) PutByte(0); // set by FrameClose()
+   };
+}
+
+static void FrameClose(BYTE more)
+{
+   OutBuffer[(FrameHeader + 1) % OUTBUFFER_LEN] = FrameLen | more;
+
+   if(FrameStamped)
+   {
+      BYTE k;
+      xdata BYTE done[STAMP_LEN];
+
+      Stamp(done);
+      for(k=0;k<STAMP_LEN;k++)
+         OutBuffer[(FrameHeader + 2 + STAMP_LEN + k) % OUTBUFFER_LEN] = done[k];
+
+      Pending += 2*STAMP_LEN;
+   };
+
+   Pending += 2 + FrameLen;
+   FrameOpen = FALSE;
+}
+
+static void FrameEnd(void)
+{
+   if(FrameOpen) FrameClose(0);
+}
+
+void OutputByte(BYTE d)
+{
+   PutByte(d);
+
+   if(!FrameOpen)
+   {
+      Pending++;
+   }
+   else if(++FrameLen == FRAME_MAX)
+   {
+      FrameClose(FRAME_MORE);
+      FrameBegin(FrameTag);
+   };
+}
+
+BYTE OutputSpace(void)
+{
+   WORD u = Pending;
+   WORD n;
+
+   // Open frame, and the header of the one it might be split into
+
+   if(FrameOpen) u += FRAME_HEADER + FrameLen + FRAME_HEADER;
+   if(u >= OUTBUFFER_LEN) return 0;
+
+   n = OUTBUFFER_LEN - u;
+   return (n > 0xFF) ? 0xFF : n;
+}
+
+//-----------------------------------------------------------------------------
+// Passive serial configuration engine. Altera devices in PS mode take their
+// configuration data LSB first on DATA0, clocked by DCLK; that's just the
+// same as byte shift mode, but without the 63 byte limit and the overhead
+// of a header byte per 63 bytes. Exactly one result byte is sent to the
+// host, ((nSTATUS<<1)|CONF_DONE) plus PS_ERR_* flags, either as soon as an
+// error is detected or after the last byte of the payload.
+
+static void PSReport(BYTE flags)
+{
+   OutputByte(flags | ProgIO_Set_Get_State(PS_IDLE));
+   PSReported = TRUE;
+}
+
+static void PSTimeout(void)
+{
+   PSTimedOut = TRUE;
+}
+
+static void PSConfigBegin(void)
+{
+   PSReported = FALSE;
+   StreamMode = STREAM_PS;
+
+   ProgIO_Set_State(PS_IDLE & ~PS_NCONFIG);
+   udelay(40);
+   ProgIO_Set_State(PS_IDLE);
+
+   // nSTATUS is released by the device within 40us (Cyclone). Data is
+   // held back by JOB_PS until then, at most 10 to 20ms.
+
+   sched_cancel(PSTimer);
+   PSTimedOut = FALSE;
+   PSTimer = sched_after(PS_START_TICKS, PSTimeout);
+   if(PSTimer == SCHED_NONE) PSTimedOut = TRUE; // one look only
+}
+
+static BOOL PSStartPoll(void)
+{
+   if(ProgIO_Set_Get_State(PS_IDLE) & PS_NSTATUS)
+   {
+      sched_cancel(PSTimer);
+      PSTimer = SCHED_NONE;
+      return TRUE;
+   };
+
+   if(!PSTimedOut) return FALSE;
+
+   PSTimer = SCHED_NONE;
+   PSReport(PS_ERR_START);
+   StreamMode = STREAM_DISCARD;
+   return TRUE;
+}
+
+static void PSConfigData(WORD m)
+{
+   while(m > 0)
+   {
+      BYTE k = (m > 0xFF) ? 0xFF : m;
+      ProgIO_ShiftOut_Block(k);
+      m -= k;
+   };
+
+   // Checked once per chunk only; a CRC error doesn't need faster reaction
+
+   if(!(ProgIO_Set_Get_State(PS_IDLE) & PS_NSTATUS))
+   {
+      PSReport(PS_ERR_STREAM);
+      StreamMode = STREAM_DISCARD;
+   };
+}
+
+static void PSConfigEnd(void)
+{
+   BYTE k;
+
+   if(PSReported) return;
+
+   if(ProgIO_Set_Get_State(PS_IDLE) & PS_CONF_DONE)
+   {
+      for(k=0;k<PS_INIT_BYTES;k++) ProgIO_ShiftOut(0xFF);
+   };
+
+   PSReport(0);
+}
+
+//-----------------------------------------------------------------------------
+// Macro definition: MacroParams[k] slot offsets, then the body
+
+static void MacroData(WORD m)
+{
+   BYTE k = MacroDefined;
+   BYTE p = MacroParams[k];
+
+   while(m--)
+   {
+      BYTE d = XAUTODAT1;
+
+      if(MacroFill < p)
+         MacroSlot[k][MacroFill] = d;
+      else
+         MacroBody[k][MacroFill - p] = d;
+
+      MacroFill++;
+   };
+}
+
+static void MacroRun(BYTE k)
+{
+   BYTE i;
+
+   // Not from within a macro
+   if(k >= MACRO_COUNT || MacroPos != MacroEnd) return;
+
+   for(i=0;i<MacroParams[k];i++)
+   {
+      BYTE o = MacroSlot[k][i];
+      if(o < MacroLen[k]) MacroBody[k][o] = ExtArg[1+i];
+   };
+
+   MacroPos = (WORD)MacroBody[k];
+   MacroEnd = MacroPos + MacroLen[k];
+   MacroCalled = TRUE;
+}
+
+//-----------------------------------------------------------------------------
+// Payload of extended commands, m bytes at XAUTODAT1
+
+static void StreamData(WORD m)
+{
+   StreamBytes -= m;
+
+   switch(StreamMode)
+   {
+      case STREAM_PS:  PSConfigData(m); break;
+      case STREAM_AS:  epcs_program_data(m); break;
+      case STREAM_TAP:
+      case STREAM_TAP_READ: tap_scan_data(m); break;
+      case STREAM_CHAIN: tap_chain_data(m); break;
+      case STREAM_XCFG: xcfg_data(m); break;
+      case STREAM_MACRO: MacroData(m); break;
+      case STREAM_POLL: tap_poll_data(m); break;
+      case STREAM_RANGES: tap_ranges_data(m); break;
+      case STREAM_VECTOR:
+      case STREAM_VECTOR_READ: tap_vector_data(m); break;
+      default:         while(m--) (void)XAUTODAT1; break;
+   };
+
+   if(StreamBytes == 0)
+   {
+      switch(ExtCmd) // the command that the payload belongs to
+      {
+         case CMD_PS_CONFIG:  PSConfigEnd(); break;
+         case CMD_AS_PROGRAM: epcs_program_end(); Job = JOB_EPCS; break;
+         case CMD_TAP_CHAIN:  tap_chain_end(); break;
+         case CMD_XCFG:       xcfg_end(); break;
+         case CMD_TAP_POLL:   if(StreamMode == STREAM_POLL) Job = JOB_POLL; break;
+         case CMD_TAP_RANGES: tap_ranges_end(); break;
+      };
+   };
+}
+
+static void RunJob(void)
+{
+   switch(Job)
+   {
+      case JOB_EPCS: if(epcs_poll()) Job = JOB_NONE; break;
+      case JOB_TAP:  if(tap_runtest_poll()) Job = JOB_NONE; break;
+      case JOB_SAMPLE: if(tap_sample_poll()) Job = JOB_NONE; break;
+      case JOB_POLL: if(tap_poll_poll()) Job = JOB_NONE; break;
+      case JOB_WAIT: if(WaitPoll()) Job = JOB_NONE; break;
+      case JOB_PS:
+         if(!PSStartPoll()) break;
+         Job = JOB_NONE;
+         if(StreamBytes == 0) PSConfigEnd(); // no payload
+         break;
+      case JOB_XCFG:
+         if(!xcfg_init_poll()) break;
+         Job = JOB_NONE;
+         if(StreamBytes == 0) xcfg_end(); // no payload
+         break;
+      default:       Job = JOB_NONE; break;
+   };
+}
+
+static BYTE ExtArgCount(BYTE cmd)
+{
+   switch(cmd)
+   {
+      case CMD_PS_CONFIG:     return 4;
+      case CMD_AS_READ:       return 5;
+      case CMD_AS_PROGRAM:    return 4;
+      case CMD_AS_ERASE:      return 3;
+      case CMD_TAP_GOTO:      return 1;
+      case CMD_TAP_SCAN_IR:   return 3;
+      case CMD_TAP_SCAN_DR:   return 3;
+      case CMD_TAP_RUNTEST:   return 5;
+      case CMD_TAP_CHAIN:     return 1;
+      case CMD_TAP_SELECT:    return 1;
+      case CMD_TAP_SAMPLE:    return 5;
+      case CMD_XCFG:          return 4;
+      case CMD_MACRO_DEFINE:  return 3;
+      case CMD_MACRO_RUN:     return 1; // plus parameters, see ExtCommandByte
+      case CMD_TAP_POLL:      return 7;
+      case CMD_WAIT:          return 4;
+      case CMD_TAP_RANGES:    return 1;
+      case CMD_FRAME_BEGIN:   return 1;
+      case CMD_VECTOR:        return 3;
+   };
+   return 0;
+}
+
+static unsigned long ExtArgValue(BYTE first, BYTE count)
+{
+   unsigned long v = 0;
+   while(count--) v = (v<<8) | ExtArg[first+count];
+   return v;
+}
+
+static void ExtExecute(void)
+{
+   switch(ExtCmd)
+   {
+      case CMD_PS_CONFIG:
+      {
+         StreamBytes = ExtArgValue(0, 4);
+         PSConfigBegin();
+         Job = JOB_PS;
+         break;
+      };
+
+      case CMD_AS_READ:
+      {
+         if(epcs_read_begin(ExtArgValue(0, 3), ExtArgValue(3, 2)))
+            Job = JOB_EPCS;
+         break;
+      };
+
+      case CMD_AS_PROGRAM:
+      {
+         epcs_program_begin(ExtArgValue(0, 3));
+         StreamBytes = ExtArg[3] ? ExtArg[3] : 256;
+         StreamMode = STREAM_AS;
+         break;
+      };
+
+      case CMD_AS_ERASE:
+      case CMD_AS_ERASE_BULK:
+      {
+         epcs_erase(ExtArgValue(0, 3), ExtCmd == CMD_AS_ERASE_BULK);
+         Job = JOB_EPCS;
+         break;
+      };
+
+      case CMD_TAP_GOTO:
+      {
+         tap_goto(ExtArg[0]);
+         LastState = TAP_PINS;
+         break;
+      };
+
+      case CMD_TAP_SCAN_IR:
+      case CMD_TAP_SCAN_DR:
+      {
+         WORD bits = ExtArgValue(0, 2);
+
+         StreamBytes = (bits >> 3) + ((bits & 7) != 0);
+         StreamMode = STREAM_DISCARD;
+
+         if(!tap_stable(ExtArg[2])) break; // TDI data is dropped
+
+         tap_scan_begin(ExtCmd == CMD_TAP_SCAN_IR, bits, ExtArg[2]);
+         StreamMode = (ExtArg[2] & TAP_CAPTURE) ? STREAM_TAP_READ : STREAM_TAP;
+         LastState = TAP_PINS;
+         break;
+      };
+
+      case CMD_TAP_RUNTEST:
+      {
+         if(!tap_stable(ExtArg[4])) break;
+         tap_runtest_begin(ExtArg[4], ExtArgValue(0, 4));
+         LastState = TAP_PINS;
+         Job = JOB_TAP;
+         break;
+      };
+
+      case CMD_TAP_CHAIN:
+      {
+         tap_chain_begin(ExtArg[0]);
+         StreamBytes = 5 * (WORD)ExtArg[0];
+         StreamMode = STREAM_CHAIN;
+         if(StreamBytes == 0) tap_chain_end();
+         break;
+      };
+
+      case CMD_TAP_SELECT:
+      {
+         tap_select(ExtArg[0]);
+         break;
+      };
+
+      case CMD_TAP_SAMPLE:
+      {
+         tap_sample_begin(ExtArgValue(0, 2), ExtArgValue(2, 2), ExtArg[4]);
+         LastState = TAP_PINS;
+         Job = JOB_SAMPLE;
+         break;
+      };
+
+      case CMD_XCFG:
+      {
+         StreamBytes = ExtArgValue(0, 4);
+         StreamMode = STREAM_XCFG;
+         xcfg_begin(StreamBytes);
+         LastState = TAP_PINS;
+         Job = JOB_XCFG;
+         break;
+      };
+
+      case CMD_MACRO_DEFINE:
+      {
+         BYTE k = ExtArg[0];
+
+         StreamBytes = ExtArg[1] + ExtArg[2];
+         StreamMode = STREAM_DISCARD;
+
+         if(k < MACRO_COUNT && ExtArg[1] <= MACRO_PARAMS
+            && ExtArg[2] <= MACRO_SIZE && MacroPos == MacroEnd)
+         {
+            MacroDefined = k;
+            MacroFill = 0;
+            MacroParams[k] = ExtArg[1];
+            MacroLen[k] = ExtArg[2];
+            StreamMode = STREAM_MACRO;
+         };
+         break;
+      };
+
+      case CMD_MACRO_RUN:
+      {
+         MacroRun(ExtArg[0]);
+         break;
+      };
+
+      case CMD_TAP_POLL:
+      {
+         BYTE bits = ExtArg[0];
+
+         StreamBytes = 3 * ((bits+7) >> 3);
+         StreamMode = STREAM_DISCARD;
+
+         if(bits > 0 && bits <= 8*TAP_POLL_BYTES && tap_stable(ExtArg[2]))
+         {
+            tap_poll_begin(ExtArg[1] & 1, bits, ExtArg[2],
+                           ExtArgValue(3, 2), ExtArgValue(5, 2));
+            StreamMode = STREAM_POLL;
+         };
+         break;
+      };
+
+      case CMD_WAIT:
+      {
+         WaitBegin(ExtArgValue(0, 4));
+         Job = JOB_WAIT;
+         break;
+      };
+
+      case CMD_TAP_RANGES:
+      {
+         tap_ranges_begin(ExtArg[0]);
+         StreamBytes = 4 * (WORD)ExtArg[0];
+         StreamMode = STREAM_RANGES;
+         if(StreamBytes == 0) tap_ranges_end();
+         break;
+      };
+
+      case CMD_FRAME_BEGIN:
+      {
+         BYTE k;
+
+         FrameEnd();
+         FrameStamped = (Timestamps & STAMP_FRAMES) ? TRUE : FALSE;
+         for(k=0;k<STAMP_LEN;k++) FrameRxStamp[k] = RxStamp[k];
+         FrameBegin(ExtArg[0]);
+         break;
+      };
+
+      case CMD_FRAME_END:
+      {
+         FrameEnd();
+         break;
+      };
+
+      case CMD_VECTOR:
+      {
+         WORD clocks = ExtArgValue(0, 2);
+
+         tap_vector_begin(clocks, ExtArg[2] & 1);
+         StreamBytes = (clocks >> 2) + ((clocks & 3) != 0);
+         StreamMode = (ExtArg[2] & 1) ? STREAM_VECTOR_READ : STREAM_VECTOR;
+         LastState = TAP_PINS;
+         break;
+      };
+
+      default: /* Unknown commands are ignored */
+         break;
+   };
+}
+
+//-----------------------------------------------------------------------------
+// Set the pins outside of command processing (flush, chain select). Until
+// the target supply is up (Ready), this only records the state, so that
+// no output is driven (or enabled) into an unpowered target.
+
+static void SetPins(BYTE d)
+{
+   LastState = d;
+   PinsOwed = !Ready;
+   if(Ready) ProgIO_Set_State(d);
+}
+
+//-----------------------------------------------------------------------------
+// Drop all queued input and whatever command is in progress. A scan cut
+// short is ended by tap_abort(), so the next one starts with a Capture.
+// Before Ready, nothing can have been clocked and the TAP is left alone.
+
+static void Abort(void)
+{
+   if(Job == JOB_EPCS || (StreamBytes && StreamMode == STREAM_AS))
+      epcs_abort(); // don't leave the flash selected mid-instruction
+
+   sched_cancel(PSTimer); // the slot may be reused before the next PS start
+   PSTimer = SCHED_NONE;
+
+   ClockBytes = 0;
+   StreamBytes = 0;
+   ExtState = EXT_IDLE;
+   Job = JOB_NONE;
+   MacroPos = MacroEnd;
+   FrameEnd();
+   RxPos = RxLen; // skip rest of current packet
+
+   if(Ready && tap_abort()) LastState = TAP_PINS;
+}
+
+//-----------------------------------------------------------------------------
+// Throw away everything the host has sent or not yet fetched: both EP2
+// buffers, the remainder of any command (see Abort()) and the readback in
+// OutBuffer. A packet already armed on EP1 IN can't be taken back and
+// still reaches the host. The pins are left with TCK low, TMS/nCONFIG and
+// nCS high.
+
+static void Flush(void)
+{
+   Abort();
+
+   RxBusy = FALSE;
+   Paused = FALSE;
+
+   Pending = 0;
+   FirstDataInOutBuffer = 0;
+   FirstFreeInOutBuffer = 0;
+   FrameOpen = FALSE;
+
+   FIFORESET = 0x80; SYNCDELAY;    // NAK all while resetting
+   FIFORESET = 0x02; SYNCDELAY;
+   FIFORESET = 0x00; SYNCDELAY;
+
+   ArmEP2();
+
+   SetPins(FLUSH_STATE);
+
+   FlushGeneration++;
+}
+
+//-----------------------------------------------------------------------------
+// Make chain c the one that following commands work on. The pin state and
+// TAP state (with chain descriptor) of the previous chain are kept until
+// it is selected again. Refused while a command is still being processed,
+// as the rest of it was meant for the previous chain.
+
+static BOOL SelectChain(BYTE c)
+{
+   if(c >= PROGIO_CHAINS) return FALSE;
+   if(ExtState != EXT_IDLE || StreamBytes || ClockBytes || Job != JOB_NONE
+      || MacroPos != MacroEnd) return FALSE;
+   if(c == Chain) return TRUE;
+
+   ChainPins[Chain] = LastState;
+   tap_context_save(ChainTap[Chain]);
+
+   Chain = c;
+   ProgIO_Set_Chain(c);
+
+   SetPins(ChainPins[c]);
+   tap_context_load(ChainTap[c]);
+
+   return TRUE;
+}
 
 //-----------------------------------------------------------------------------
+// In quiet keepalive mode, the IN-BULK-NAK interrupt tells that the host
+// is waiting for more data on EP1. It is enabled only while a status
+// packet is owed and disables itself, as it would fire with every NAK.
 
-void usb_jtag_init(void)              // Called once at startup
+static void isr_IBN(void) interrupt
 {
-   WORD tmp;
+   clear_usb_irq();
+   IBNIE &= ~bmEP1IBN;
+   IBNIRQ = bmEP1IBN;
+   NAKIRQ = bmIBN;
+   InRequested = TRUE;
+}
 
-   Running = FALSE;
-   ClockBytes = 0;
-   Pending = 0;
-   WriteOnly = TRUE;
-   FirstDataInOutBuffer = 0;
-   FirstFreeInOutBuffer = 0;
+static void SetKeepaliveMode(BYTE m)
+{
+   IBNIE &= ~bmEP1IBN;
+   StatusOwed = FALSE;
+   InRequested = FALSE;
 
-   ProgIO_Init();
+   if(m == KEEPALIVE_QUIET)
+   {
+      hook_uv(UV_IBN, (unsigned short) isr_IBN);
+      IBNIRQ = bmEP1IBN;
+      NAKIRQ = bmIBN;
+      NAKIE |= bmIBN;
+      KeepaliveMode = KEEPALIVE_QUIET;
+   }
+   else
+   {
+      NAKIE &= ~bmIBN;
+      KeepaliveMode = KEEPALIVE_FT245;
+      KeepaliveDue = TRUE; // resume with a status packet
+   };
+}
 
-   ProgIO_Enable();
+//-----------------------------------------------------------------------------
+// The priority channel takes short commands on EP1 OUT and answers them on
+// EP8 IN. It is serviced before EP2, i.e. at least once per EP2 packet, so
+// the host can monitor and control a long running job. Each command byte
+// is echoed, followed by its answer (multi-byte values little endian):
+//
+//   0x01  Pin state: last state set in bit banging mode, then state of
+//         input pins as with the "Read bit" in bit banging mode (2 bytes)
+//   0x02  Counters: bytes received on EP2 (4 bytes), bytes sent to host
+//         (4), bytes waiting in output buffer (2), remaining payload of
+//         extended command (4), current job (1), paused (1)
+//   0x03  Pause processing of EP2 data (output is still sent)
+//   0x04  Resume processing of EP2 data
+//   0x05  Abort current command and drop rest of current EP2 packet
+//
+// If the answers to an EP1 packet don't fit into one EP8 packet, the rest
+// of the commands is processed once the host has fetched the answers so
+// far. EP1 OUT stays unarmed (NAKs) until all commands are done.
 
-   // Make Timer2 reload at 100 Hz to trigger Keepalive packets
+static WORD PriorityPut(WORD o, unsigned long v, BYTE n)
+{
+   while(n--)
+   {
+      EP8FIFOBUF[o++] = v;
+      v >>= 8;
+   };
+   return o;
+}
 
-   tmp = 65536 - ( 48000000 / 12 / 100 );
-   RCAP2H = tmp >> 8;
-   RCAP2L = tmp & 0xFF;
-   CKCON = 0; // Default Clock
-   T2CON = 0x04; // Auto-reload mode using internal clock, no baud clock.
+static void PriorityChannel(void)
+{
+   BYTE n;
+   WORD o;
 
-   // Enable Autopointer
+   if(EP1OUTCS & bmEPBUSY) return;
+   if(EP2468STAT & bmEP8FULL) return; // host didn't fetch previous answers
 
-   EXTACC = 1;  // Enable
-   APTR1FZ = 1; // Don't freeze
-   APTR2FZ = 1; // Don't freeze
+   n = EP1OUTBC;
 
-   // define endpoint configuration
+   // Largest answer is 17 bytes, stop early rather than exceed the 64 byte
+   // packet size announced for EP8; the rest follows in the next packet
 
-   FIFORESET = 0x80; SYNCDELAY;    // From now on, NAK all
-   REVCTL = 3; SYNCDELAY;          // Allow FW access to FIFO buffer
+   for(o=0; PriorityPos<n && o<=64-17; PriorityPos++)
+   {
+      BYTE c = EP1OUTBUF[PriorityPos];
 
-   EP1OUTCFG  = 0xA0; SYNCDELAY;
-   EP1INCFG   = 0xA0; SYNCDELAY;
+      EP8FIFOBUF[o++] = c;
 
-   EP2FIFOCFG = 0x00; SYNCDELAY;
-   FIFORESET  = 0x02; SYNCDELAY;
-   EP2CFG     = 0xA2; SYNCDELAY;
+      switch(c)
+      {
+         case PRI_GET_PINS:
+            EP8FIFOBUF[o++] = LastState;
+            EP8FIFOBUF[o++] = ProgIO_Get_State();
+            break;
 
-   EP4FIFOCFG = 0x00; SYNCDELAY;
-   FIFORESET  = 0x04; SYNCDELAY;
-   EP4CFG     = 0xA0; SYNCDELAY;
+         case PRI_GET_COUNTERS:
+            o = PriorityPut(o, RxTotal, 4);
+            o = PriorityPut(o, TxTotal, 4);
+            o = PriorityPut(o, Pending, 2);
+            o = PriorityPut(o, StreamBytes, 4);
+            EP8FIFOBUF[o++] = Job;
+            EP8FIFOBUF[o++] = Paused;
+            break;
 
-   EP6FIFOCFG = 0x00; SYNCDELAY;
-   FIFORESET  = 0x06; SYNCDELAY;
-   EP6CFG     = 0xE2; SYNCDELAY;
+         case PRI_PAUSE:  Paused = TRUE;  break;
+         case PRI_RESUME: Paused = FALSE; break;
+         case PRI_ABORT:  Abort();        break;
+      };
+   };
 
-   EP8FIFOCFG = 0x00; SYNCDELAY;
-   FIFORESET  = 0x08; SYNCDELAY;
-   EP8CFG     = 0xE0; SYNCDELAY;
+   if(o > 0) // no empty answer to an empty EP1 packet
+   {
+      SYNCDELAY;
+      EP8BCH = MSB( o );
+      SYNCDELAY;
+      EP8BCL = LSB( o );
+   };
 
-   FIFORESET  = 0x00; SYNCDELAY;   // Restore normal behaviour
-   REVCTL = 0; SYNCDELAY;          // Reset FW access to FIFO buffer
+   if(PriorityPos < n) return; // more commands, keep EP1 OUT unarmed
 
-   // out endpoints do not come up armed
-   // since the defaults are double buffered we must write dummy byte counts twice
-   SYNCDELAY;                    // 
-   EP2BCL = 0x80;                // arm EP2OUT by writing byte count w/skip.
-   SYNCDELAY;                    // 
-   EP4BCL = 0x80;    
-   SYNCDELAY;                    // 
-   EP2BCL = 0x80;                // arm EP4OUT by writing byte count w/skip.
-   SYNCDELAY;                    // 
-   EP4BCL = 0x80;    
+   PriorityPos = 0;
+   SYNCDELAY;
+   EP1OUTBC = 0; // Re-arm endpoint 1
 }
 
-void OutputByte(BYTE d)
+static void ExtCommandByte(BYTE d)
 {
-#ifdef USE_MOD256_OUTBUFFER
-   OutBuffer[FirstFreeInOutBuffer] = d;
-   FirstFreeInOutBuffer = ( FirstFreeInOutBuffer + 1 ) & 0xFF;
-#else
-   OutBuffer[FirstFreeInOutBuffer++] = d;
-   if(FirstFreeInOutBuffer >= OUTBUFFER_LEN) FirstFreeInOutBuffer = 0;
-#endif
-   Pending++;
+   if(ExtState == EXT_OPCODE)
+   {
+      ExtCmd = d;
+      ExtArgPos = 0;
+      ExtArgLen = ExtArgCount(d);
+      ExtState = EXT_ARGS;
+   }
+   else
+   {
+      ExtArg[ExtArgPos++] = d;
+
+      if(ExtCmd == CMD_MACRO_RUN && ExtArgPos == 1 && d < MACRO_COUNT)
+         ExtArgLen += MacroParams[d];
+   };
+
+   if(ExtArgPos >= ExtArgLen)
+   {
+      ExtState = EXT_IDLE;
+      ExtExecute();
+   };
 }
 
 //-----------------------------------------------------------------------------
@@ -200,6 +1300,144 @@ void OutputByte(BYTE d)
 //      record the shift register content and put it into the FIFO
 //      _to_ the host.
 //
+// Extended commands:
+//
+//   A byte shift mode header with zero length and no "Read bit" (0x80) is
+//   useless for the USB-Blaster and is used here as an escape. The byte
+//   following it is an opcode, followed by a fixed number of argument bytes
+//   and, for some opcodes, a payload of a length given in the arguments.
+//   Afterwards, the decoder is in bit banging mode again. Unknown opcodes
+//   are ignored (without arguments). Multi-byte arguments are little endian.
+//
+//   0x80 0x01 L0 L1 L2 L3 <L bytes>   Passive serial configuration:
+//      Pulse nCONFIG, wait for nSTATUS, then shift out L bytes on DATA0/DCLK
+//      (LSB first). nSTATUS is checked after every packet and configuration
+//      aborted (remaining payload discarded) if it goes low. One result byte
+//      is sent to the host: ((nSTATUS<<1)|CONF_DONE), plus 0x80 if nSTATUS
+//      didn't go high after the nCONFIG pulse or 0x40 if it went low while
+//      streaming. If CONF_DONE was high, 256 more DCLK cycles are given for
+//      initialization before the result is read.
+//
+//   EPCS serial configuration devices are accessed using the AS pins, with
+//   nCONFIG held low and nCE high to keep the FPGA off the lines. The pins
+//   are left in that state afterwards. Data bytes are shifted LSB first, as
+//   in byte shift mode, instructions and addresses are sent MSB first. A
+//   is a 24 bit flash address. Where the result is the status register, it
+//   is sent after the device has finished (WIP bit cleared).
+//
+//   0x80 0x02 A0 A1 A2 N0 N1          Read N bytes from address A
+//   0x80 0x03 A0 A1 A2 N <N bytes>    Write enable, program N bytes (0: 256)
+//                                     at A, result: status register
+//   0x80 0x04 A0 A1 A2                Write enable, erase sector containing
+//                                     A, result: status register
+//   0x80 0x05                         Write enable, erase all, result:
+//                                     status register
+//
+//   The state of the TAP controller is tracked, also through TCK edges in
+//   bit banging and byte shift mode, so that these commands can be mixed
+//   with others. After PS or EPCS commands (which use TMS as nCONFIG) the
+//   state is unknown; use 0x10 0x00 to reset. States S are numbered as in
+//   XSVF (0 Test-Logic-Reset, 1 Run-Test/Idle, 4 Shift-DR, 6 Pause-DR,
+//   11 Shift-IR, 13 Pause-IR, ...). TDI data is LSB first, as in byte
+//   shift mode. End states E and S of scans, 0x13 and 0x1A must be
+//   stable (0, 1, 6 or 13); otherwise the command is ignored (and its
+//   payload dropped).
+//
+//   0x80 0x10 S                       Move to state S
+//   0x80 0x11 N0 N1 E <(N+7)/8 bytes> Shift N bits through IR, then move
+//                                     to state E. Add 0x80 to E to have
+//                                     the TDO bits sent to the host, one
+//                                     byte for each byte of TDI data, and
+//                                     0x40 to shift bytes MSB first.
+//   0x80 0x12 N0 N1 E <(N+7)/8 bytes> Same for DR
+//   0x80 0x13 C0 C1 C2 C3 S           Move to stable state S, give C TCK
+//                                     cycles there
+//   0x80 0x14 N <N*5 bytes>           Chain descriptor for N (up to 8)
+//                                     devices, the first nearest to TDO:
+//                                     IR length L (1..32), bypass code B0
+//                                     B1 B2 B3 (LSB first)
+//   0x80 0x15 K                       Scan only device K (0xFF: all, the
+//                                     default). Scans are then padded for
+//                                     the other devices: IR with bypass
+//                                     codes, DR with one bit per device.
+//   0x80 0x16 N0 N1 C0 C1 F           Boundary scan sampling: repeat C
+//                                     times (0: until aborted through the
+//                                     priority channel or vendor request
+//                                     0xB0) a DR scan of N bits (TDI low)
+//                                     through Capture-DR, sending (N+7)/8
+//                                     bytes of TDO each, preceded by a 16
+//                                     bit frame counter if F is 1. Ends
+//                                     in Run-Test/Idle. Load SAMPLE into
+//                                     IR before.
+//   0x80 0x17 L0 L1 L2 L3 <L bytes>   Xilinx configuration through JTAG
+//                                     (Spartan-3E, 6 bit IR) of the
+//                                     selected device with a .bit or .bin
+//                                     file: JPROGRAM, wait for INIT_B,
+//                                     CFG_IN, bitstream (MSB first),
+//                                     JSTART, 16 clocks in Run-Test/Idle.
+//                                     One result byte: the BYPASS IR
+//                                     capture (0x20 DONE, 0x10 INIT_B,
+//                                     0x01), plus 0x80 if INIT_B didn't
+//                                     go high or 0x40 if the payload was
+//                                     shorter than the bitstream. Ends in
+//                                     Test-Logic-Reset.
+//   0x80 0x1A N F E C0 C1 T0 T1 <3 x (N+7)/8 bytes>
+//                                     Poll: repeat a scan of N (1..32)
+//                                     bits through DR (IR if F is 1), then
+//                                     to state E, with the TDI data given
+//                                     first, until (TDO & mask) == value
+//                                     (mask and value follow TDI data), C
+//                                     scans were done or T * 10ms passed
+//                                     (0: no limit). Sends the TDO of the
+//                                     last scan, then the number of scans
+//                                     (16 bit, stops at 65535).
+//   0x80 0x1B U0 U1 U2 U3             Wait U microseconds (timed by the
+//                                     FX2, not the host) before decoding
+//                                     further input; the pins are left as
+//                                     they are.
+//   0x80 0x1C R <R*4 bytes>           Selective capture for the next scan
+//                                     with TDO sent to the host (0x11,
+//                                     0x12 with E|0x80): R (up to 8) bit
+//                                     ranges, each first bit F0 F1 and
+//                                     length L0 L1, ascending and not
+//                                     overlapping. Only the bits in these
+//                                     ranges are sent, packed LSB first,
+//                                     the last byte padded with zeroes.
+//   0x80 0x1D T                       Tagged readback: all output from the
+//                                     following commands is sent in frames
+//                                     of tag T, length L and L bytes.
+//                                     Frames are sent only when complete,
+//                                     at the next 0x1D, at 0x1E or when
+//                                     L reaches 127; then 0x80 is added to
+//                                     L and another frame follows. Every
+//                                     batch ends with a frame with L below
+//                                     0x80 (maybe 0 bytes), so its end can
+//                                     be seen by the host. See 0xB5 below
+//                                     for timestamps in the frame header.
+//   0x80 0x1E                         End tagged readback
+//   0x80 0x1F N0 N1 F <(N+3)/4 bytes> Vectors: N TCK cycles, TMS and TDI
+//                                     for each from a pair of bits, four
+//                                     pairs per byte starting with bits 0
+//                                     (TMS) and 1 (TDI). If F is 1, TDO
+//                                     is sent to the host, 8 cycles per
+//                                     byte, LSB first.
+//
+//   Macros are command sequences (any of the above, including bit banging
+//   and byte shift mode) stored in the device and invoked with just a few
+//   bytes. Up to 8 macros of up to 64 bytes each, with up to 4 parameter
+//   bytes that are written into the body before it runs. A macro can't
+//   invoke another one, and it should end with a complete command.
+//
+//   0x80 0x18 K P N <P bytes> <N bytes>
+//                                     Define macro K (0..7) with P
+//                                     parameters at the body offsets given
+//                                     in the first P bytes, then N bytes
+//                                     body. Invalid definitions are
+//                                     discarded.
+//   0x80 0x19 K <P bytes>             Run macro K with P parameter bytes
+//   0xC0 K <P bytes>                  Same (a byte shift header with "Read
+//                                     bit" and zero length is useless too)
+//
 // Some more (minor) things to consider to emulate the FT245BM:
 //
 //   a) The FT245BM seems to transmit just packets of no more than 64 bytes
@@ -219,15 +1457,238 @@ void OutputByte(BYTE d)
 //      in my code. Only those for reading the EEPROM are processed. See
 //      DR_GetStatus and DR_VendorCmd below for my implementation.
 //
+//      Additional vendor requests (device-to-host, answering 2 bytes):
+//
+//      0xB0  Flush: discard all data in EP2 and OutBuffer, abort the
+//            current command and set pins to a defined state. Answers
+//            with a generation counter incremented by each flush.
+//
+//      0xB6  Adaptive clocking (wValue): 0 off (default), 1..255 makes
+//            each TCK edge wait until RTCK follows, at most that many
+//            polling loops (about 1us each). For hardware with an RTCK
+//            input only (hw_basic or hw_nexys2 with HAVE_RTCK defined).
+//            Answers with the number of edges that timed out since the
+//            previous 0xB6.
+//
+//      Additional vendor requests (host-to-device, no data stage):
+//
+//      0xB1  Keepalive mode (wValue): 0 sends a status packet every 10ms
+//            and after each data packet (default, as needed by the
+//            original driver), 1 sends status packets only after a full
+//            size data packet and only when the host asks for more data.
+//
+//      0xB2  TDO sample point (wValue) for byte shift mode with "Read bit":
+//            0 right after the falling edge of TCK (default), 1..254 after
+//            that many delay loops (250ns each in the assembler kernels),
+//            255 after the falling edge that ends the bit, for TDO that
+//            lags about one TCK cycle behind on long cables.
+//
+//      0xB5  USB frame counter stamps, 3 bytes each: USBFRAMEL,
+//            USBFRAMEH, MICROFRAME. wValue bit 0: frames of tagged
+//            readback started afterwards have 6 more header bytes after
+//            L, the stamps of the arrival of the EP2 packet with their
+//            0x1D command and of their completion. Bit 1: status packets
+//            without data have a frame with tag 0xFF and 3 bytes, the
+//            stamp of their sending, after 0x31 0x60.
+//
+//      0xB7  JTAG chain (wValue) on adapters with more than one: with
+//            HARDWARE=hw_xpcu, 0 the target (default), 1 the cable CPLD.
+//            Pin and TAP state (and 0x80 0x14 descriptor) are kept per
+//            chain. Stalls for chains that don't exist and while a command
+//            is still being processed.
+//
+//      Vendor requests as in Cypress' Vend_Ax, for use with fxload -e
+//      (writes the boot EEPROM without replacing this firmware by a
+//      second stage loader, as fxload -s would):
+//
+//      0xA2  Read (IN) or write (OUT) wLength bytes of the FX2 boot EEPROM
+//            at address wValue. Writes use I2C page writes at 400 kHz,
+//            each followed by ACK polling. The page size is 32 bytes (8
+//            for EEPROMs with one address byte) unless wIndex gives a
+//            different one (up to 64).
+//      0xA5  Answers 1 byte: 1 for an EEPROM with two address bytes.
+//
+//      0xB3  Boot timestamps, 6 x 4 bytes: microseconds from startup until
+//            init done, ready to renumerate, reconnected, first setup
+//            packet, target ready, first FT245 reset from host; 0xFFFFFFFF
+//            for phases not reached yet.
+//
+//      0xB4  Setup latency, 2 x 2 bytes: the longest time (us, 0xFFFF
+//            for 20ms or more) a setup packet might have waited for the
+//            main loop, and the number of setup packets measured. Both
+//            are cleared after reading.
+//
 //   All other TD_ and DR_ functions remain as provided with CY3681.
 //
 //-----------------------------------------------------------------------------
 
+static WORD Decode(WORD i, WORD n)
+{
+   /* Decode input from xdata address i up to n, return where it stopped */
+
+   APTR1H = MSB( i );
+   APTR1L = LSB( i );
+
+   // Output for a command is at most 63 bytes. Stop (and resume with the
+   // rest of the packet later) if there might not be enough space for it.
+   // Stop as well when a macro is invoked, to decode it first.
+
+   while(i < n && Job == JOB_NONE && !MacroCalled && OutputSpace() > 0x3F
+         && !usb_setup_packet_avail())
+   {
+      if(ClockBytes > 0)
+      {
+         WORD m;
+
+         m = n-i;
+         if(ClockBytes < m) m = ClockBytes;
+         ClockBytes -= m;
+         i += m;
+
+         if(WriteOnly) /* Shift out 8 bits from d */
+         {
+            ProgIO_ShiftOut_Block(m);
+         }
+         else /* Shift in 8 bits at the other end  */
+         {
+            while(m--) OutputByte(ProgIO_ShiftInOut(XAUTODAT1));
+         }
+      }
+      else if(StreamBytes > 0)
+      {
+         WORD m;
+
+         m = n-i;
+         if(StreamBytes < m) m = StreamBytes;
+         if(m > PREEMPT_CHUNK) m = PREEMPT_CHUNK;
+         if((StreamMode == STREAM_TAP_READ || StreamMode == STREAM_VECTOR_READ)
+            && m > 0x3F) m = 0x3F;
+         i += m;
+
+         StreamData(m);
+      }
+      else if(ExtState != EXT_IDLE)
+      {
+         ExtCommandByte(XAUTODAT1);
+         i++;
+      }
+      else
+      {
+         BYTE d = XAUTODAT1;
+         WriteOnly = (d & bmBIT6) ? FALSE : TRUE;
+
+         if(d == CMD_ESCAPE)
+         {
+            /* Extended command, opcode follows */
+
+            ExtState = EXT_OPCODE;
+         }
+         else if(d == CMD_MACRO)
+         {
+            /* Macro invocation, number and parameters follow */
+
+            ExtState = EXT_OPCODE;
+            ExtCommandByte(CMD_MACRO_RUN);
+         }
+         else if(d & bmBIT7)
+         {
+            /* Prepare byte transfer, do nothing else yet */
+
+            ClockBytes = d & 0x3F;
+
+            /* Follow the TAP through 8+ cycles with TMS unchanged; it
+               settles within five */
+
+            if(ClockBytes > 0)
+            {
+               BYTE k;
+               for(k=0;k<5;k++) tap_clock(LastState & bmBIT1);
+            };
+         }
+         else
+         {
+            if((d & bmBIT0) && !(LastState & bmBIT0)) tap_clock(d & bmBIT1);
+
+            LastState = d;
+
+            if(WriteOnly)
+                ProgIO_Set_State(d);
+            else
+                OutputByte(ProgIO_Set_Get_State(d));
+         };
+         i++;
+      };
+   };
+
+   return i;
+}
+
+static void ProcessInput(void)
+{
+   // A macro invoked from EP2 input runs to its end before the rest of
+   // the packet is decoded.
+
+   for(;;)
+   {
+      MacroCalled = FALSE;
+
+      if(MacroPos != MacroEnd)
+      {
+         MacroPos = Decode(MacroPos, MacroEnd);
+         if(MacroPos != MacroEnd) return;
+      };
+
+      if(!RxBusy) return;
+
+      RxPos = Decode((WORD)EP2FIFOBUF + RxPos, (WORD)EP2FIFOBUF + RxLen)
+              - (WORD)EP2FIFOBUF;
+
+      if(!MacroCalled) return;
+   };
+}
+
+static void SendStatus(void)
+{
+   /* Status packet without data, maybe with a stamp frame */
+
+   BYTE n = 2;
+
+   EP1INBUF[0] = 0x31;
+   EP1INBUF[1] = 0x60;
+
+   if(Timestamps & STAMP_STATUS)
+   {
+      BYTE k;
+      xdata BYTE now[STAMP_LEN];
+
+      Stamp(now);
+      EP1INBUF[n++] = STAMP_TAG;
+      EP1INBUF[n++] = STAMP_LEN;
+      for(k=0;k<STAMP_LEN;k++) EP1INBUF[n++] = now[k];
+   };
+
+   SYNCDELAY;
+   EP1INBC = n;
+}
+
 void usb_jtag_activity(void) // Called repeatedly while the device is idle
 {
-   if(!Running) return;
+   PriorityChannel();
+
+   // Target power may come up only after renumeration (see ProgIO_Init)
+
+   if(!Ready)
+   {
+      Ready = ProgIO_Poll();
+      if(Ready)
+      {
+         BootPhase(BOOT_POWER);
+         if(PinsOwed) ProgIO_Set_State(LastState);
+         PinsOwed = FALSE;
+      };
+   };
 
-   ProgIO_Poll();
+   if(!Running) return;
    
    if(!(EP1INCS & bmEPBUSY))
    {
@@ -272,72 +1733,116 @@ void usb_jtag_activity(void) // Called repeatedly while the device is idle
 #endif
          SYNCDELAY;
          EP1INBC = 2 + o;
-         TF2 = 1; // Make sure there will be a short transfer soon
+         TxTotal += o;
+
+         if(KeepaliveMode == KEEPALIVE_QUIET)
+         {
+            // A full size packet doesn't end the host's transfer. Owe it a
+            // short packet, but only send it when it asks for more data.
+
+            StatusOwed = (o == 0x3E);
+            if(StatusOwed)
+            {
+               InRequested = FALSE;
+               IBNIRQ = bmEP1IBN;
+               IBNIE |= bmEP1IBN;
+            };
+         }
+         else
+         {
+            KeepaliveDue = TRUE; // Make sure there will be a short transfer soon
+         };
       }
-      else if(TF2)
+      else if(KeepaliveMode == KEEPALIVE_QUIET)
       {
-         EP1INBUF[0] = 0x31;
-         EP1INBUF[1] = 0x60;
-         SYNCDELAY;
-         EP1INBC = 2;
-         TF2 = 0;
+         if(StatusOwed && InRequested)
+         {
+            SendStatus();
+            StatusOwed = FALSE;
+         };
+      }
+      else if(KeepaliveDue)
+      {
+         SendStatus();
+         KeepaliveDue = FALSE;
       };
    };
 
-   if(!(EP2468STAT & bmEP2EMPTY) && (Pending < OUTBUFFER_LEN-0x3F))
+   if(Paused || !Ready) return;
+
+   // A job started by an extended command (e.g. reading flash) holds off
+   // processing of further input until it is complete.
+
+   if(Job != JOB_NONE) RunJob();
+
+   if(!RxBusy && !(EP2468STAT & bmEP2EMPTY))
    {
-      WORD i,n = EP2BCL|EP2BCH<<8;
+      RxLen = EP2BCL|EP2BCH<<8;
+      RxPos = 0;
+      RxBusy = TRUE;
+      Stamp(RxStamp);
+   };
 
-      APTR1H = MSB( EP2FIFOBUF );
-      APTR1L = LSB( EP2FIFOBUF );
+   if(Job == JOB_NONE && (RxBusy || MacroPos != MacroEnd)) ProcessInput();
 
-      for(i=0;i<n;)
+   if(RxBusy)
+   {
+      if(RxPos >= RxLen)
       {
-         if(ClockBytes > 0)
+         // Hand the buffer back to the USB side right away and take up
+         // the next one, if already there, without another pass.
+
+         RxTotal += RxLen;
+         RxBusy = FALSE;
+         SYNCDELAY;
+         EP2BCL = 0x80; // Re-arm endpoint 2
+
+         SYNCDELAY;
+         if(!(EP2468STAT & bmEP2EMPTY))
          {
-            WORD m;
+            RxLen = EP2BCL|EP2BCH<<8;
+            RxPos = 0;
+            RxBusy = TRUE;
+            Stamp(RxStamp);
+         };
+      };
+   };
+}
 
-            m = n-i;
-            if(ClockBytes < m) m = ClockBytes;
-            ClockBytes -= m;
-            i += m;
+//-----------------------------------------------------------------------------
+// Read or write wLength bytes of the boot EEPROM at wValue, a packet at a
+// time through EP0. wIndex may give the page size for writes.
 
-            /* Shift out 8 bits from d */
-         
-            if(WriteOnly) /* Shift out 8 bits from d */
-            {
-               while(m--) ProgIO_ShiftOut(XAUTODAT1);
-            }
-            else /* Shift in 8 bits at the other end  */
-            {
-               while(m--) OutputByte(ProgIO_ShiftInOut(XAUTODAT1));
-            }
-        }
-        else
-        {
-            BYTE d = XAUTODAT1;
-            WriteOnly = (d & bmBIT6) ? FALSE : TRUE;
-
-            if(d & bmBIT7)
-            {
-               /* Prepare byte transfer, do nothing else yet */
+static BYTE BootromTransfer(BOOL write)
+{
+   WORD addr = wValueL | (wValueH << 8);
+   WORD len = wLengthL | (wLengthH << 8);
 
-               ClockBytes = d & 0x3F;
-            }
-            else
-            {
-               if(WriteOnly)
-                   ProgIO_Set_State(d);
-               else
-                   OutputByte(ProgIO_Set_Get_State(d));
-            };
-            i++;
-         };
+   while(len > 0)
+   {
+      BYTE n = (len > 64) ? 64 : len;
+
+      if(write)
+      {
+         EP0BCL = 0; // Arm endpoint for next packet of data stage
+         while(EP0CS & bmEPBUSY);
+         n = EP0BCL;
+         if(n == 0) break;
+         if(!bootrom_write(addr, EP0BUF, n, wIndexL)) return 0;
+      }
+      else
+      {
+         while(EP0CS & bmEPBUSY);
+         if(!bootrom_read(addr, EP0BUF, n)) return 0;
+         EP0BCH = 0;
+         EP0BCL = n;
       };
 
-      SYNCDELAY;
-      EP2BCL = 0x80; // Re-arm endpoint 2
+      addr += n;
+      len -= n;
    };
+
+   return 1;
 }
 
 //-----------------------------------------------------------------------------
@@ -353,18 +1858,97 @@ unsigned char app_vendor_cmd(void)
     if(bRequest == RQ_GET_STATUS)
     {
       Running = 1;
+      BootPhase(BOOT_RUNNING);
+    }
+    else if(bRequest == RQ_KEEPALIVE)
+    {
+      SetKeepaliveMode(wValueL);
+    }
+    else if(bRequest == RQ_TDO_SAMPLE)
+    {
+      ProgIO_Set_Sample_Point(wValueL);
+    }
+    else if(bRequest == RQ_TIMESTAMPS)
+    {
+      Timestamps = wValueL;
+    }
+    else if(bRequest == RQ_CHAIN)
+    {
+      return SelectChain(wValueL);
+    }
+    else if(bRequest == RQ_BOOTROM)
+    {
+      return BootromTransfer(TRUE);
     };
     return 1;
   }
 
   // IN requests.
 
-  if(bRequest == 0x90)
+  if(bRequest == RQ_BOOTROM)
+  {
+    return BootromTransfer(FALSE);
+  }
+  else if(bRequest == RQ_BOOTROM_SIZE)
+  {
+    // 1 for an EEPROM with two address bytes, as expected by fxload
+
+    EP0BUF[0] = (bootrom_type() == 2);
+    EP0BCH = 0;
+    EP0BCL = 1;
+    return 1;
+  }
+  else if(bRequest == RQ_SETUP_LATENCY)
+  {
+    EP0BUF[0] = SetupLatencyMax;
+    EP0BUF[1] = SetupLatencyMax >> 8;
+    EP0BUF[2] = SetupCount;
+    EP0BUF[3] = SetupCount >> 8;
+    SetupLatencyMax = 0;
+    SetupCount = 0;
+
+    EP0BCH = 0;
+    EP0BCL = (wLengthL<4) ? wLengthL : 4;
+    return 1;
+  }
+  else if(bRequest == RQ_BOOT_TIMES)
+  {
+    BYTE k, n = 0;
+
+    for(k=0;k<BOOT_PHASES;k++)
+    {
+      unsigned long t = BootTime[k];
+      EP0BUF[n++] = t;
+      EP0BUF[n++] = t >> 8;
+      EP0BUF[n++] = t >> 16;
+      EP0BUF[n++] = t >> 24;
+    };
+
+    EP0BCH = 0;
+    EP0BCL = (wLengthL<n) ? wLengthL : n;
+    return 1;
+  }
+  else if(bRequest == 0x90)
   {
     BYTE addr = (wIndexL<<1) & 0x7F;
     EP0BUF[0] = eeprom[addr];
     EP0BUF[1] = eeprom[addr+1];
   }
+  else if(bRequest == RQ_ADAPTIVE)
+  {
+    // Set RTCK timeout, answer with number of timeouts until now
+
+    EP0BUF[0] = ProgIO_Set_Adaptive(wValueL);
+    EP0BUF[1] = 0;
+  }
+  else if(bRequest == RQ_FLUSH)
+  {
+    // Flush queued data, answer with number of flushes since power-up
+
+    Flush();
+    EP0BUF[0] = FlushGeneration;
+    EP0BUF[1] = 0;
+  }
   else
   {
     // dummy data
@@ -380,12 +1964,46 @@ unsigned char app_vendor_cmd(void)
 
 //-----------------------------------------------------------------------------
 
+static void SetupLatency(WORD t, BYTE k)
+{
+  /* A setup packet arrived at some time during the last pass through
+     sched_run() and usb_jtag_activity(), which began at Timer0 t and
+     tick k. Record the length of that pass as the (worst case) latency. */
+
+  WORD now = Timer0();
+  unsigned long c = (WORD)(now - t);
+  WORD us;
+
+  if(TF0 && now >= t) c += 0x10000; // Timer0 wrapped once
+
+  c /= WAIT_COUNTS_PER_US;
+  us = (c > 0xFFFF || (BYTE)((BYTE)sched_tick_count - k) > 2) ? 0xFFFF : c;
+
+  if(us > SetupLatencyMax) SetupLatencyMax = us;
+  SetupCount++;
+}
+
 static void main_loop(void)
 {
+  WORD t;
+  BYTE k;
+
   while(1)
   {
-    if(usb_setup_packet_avail()) usb_handle_setup_packet();
+    if(usb_setup_packet_avail())
+    {
+      BootPhase(BOOT_SETUP);
+      usb_handle_setup_packet();
+    };
+
+    TF0 = 0;
+    t = Timer0();
+    k = sched_tick_count;
+
+    sched_run();
     usb_jtag_activity();
+
+    if(usb_setup_packet_avail()) SetupLatency(t, k);
   }
 }
 
@@ -396,14 +2014,17 @@ void main(void)
   EA = 0; // disable all interrupts
 
   usb_jtag_init();
+  BootPhase(BOOT_INIT);
   eeprom_init();
+  bootrom_init();
   setup_autovectors ();
   usb_install_handlers ();
-
+  BootPhase(BOOT_HANDLERS);
 
   EA = 1; // enable interrupts
 
   fx2_renumerate(); // simulates disconnect / reconnect
+  BootPhase(BOOT_RENUM);
 
   main_loop();
 }
@@ -0,0 +1,32 @@
+/*-----------------------------------------------------------------------------
+ * Services of the usb_jtag core for engines in other modules
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _USBJTAG_H
+#define _USBJTAG_H 1
+
+/* Append a byte to the data sent to the host */
+extern void OutputByte(unsigned char d);
+
+/* Number of bytes that can be appended right now (max. 255) */
+extern unsigned char OutputSpace(void);
+
+/* Time since startup in 10ms ticks */
+extern unsigned short TickCount(void);
+
+#endif /* _USBJTAG_H */
+
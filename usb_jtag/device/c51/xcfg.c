@@ -0,0 +1,215 @@
+/*-----------------------------------------------------------------------------
+ * Xilinx FPGA configuration through JTAG
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#include "fx2regs.h"
+#include "hardware.h"
+#include "sched.h"
+#include "usbjtag.h"
+#include "tap.h"
+#include "xcfg.h"
+
+//-----------------------------------------------------------------------------
+// Spartan-3E (and other Xilinx devices with 6 bit IR) configuration through
+// JTAG, following UG332: JPROGRAM, wait for INIT_B, CFG_IN, shift the
+// bitstream into DR (MSB first), JSTART, some clocks in Run-Test/Idle, then
+// DONE is read from the IR capture. The bitstream is taken either from a
+// .bin file (starting with 0xFF dummy words) or from the 'e' field of a
+// .bit file, whose other fields are skipped.
+
+#define XCFG_IR_BITS   6
+#define XCFG_CFG_IN    0x05
+#define XCFG_JPROGRAM  0x0B
+#define XCFG_JSTART    0x0C
+#define XCFG_BYPASS    0x3F
+
+/* IR capture: 0x01 always, INIT_B and DONE */
+#define XCFG_IR_INIT   0x10
+#define XCFG_IR_DONE   0x20
+
+/* Added to the result byte */
+#define XCFG_ERR_INIT  0x80 // INIT_B didn't go high after JPROGRAM
+#define XCFG_ERR_DATA  0x40 // payload ended before the bitstream did
+
+#define XCFG_START_CLOCKS 16 // in Run-Test/Idle after JSTART
+
+/* INIT_B goes high when the configuration memory has been cleared, within
+   about 2ms for the largest device; allow 20ms (and up to one more tick) */
+#define XCFG_INIT_TICKS   2
+
+/* .bit files: 2 byte length, 9 byte field, then length 1 of key 'a' */
+#define XCFG_BIT_PREAMBLE 13
+
+/* Parser states */
+#define XCFG_FIRST     0 // 0xFF for .bin, otherwise .bit header
+#define XCFG_SKIP      1 // skip xcfg_count bytes, then a key follows
+#define XCFG_KEY       2
+#define XCFG_LENGTH    3 // xcfg_left more length bytes, big endian
+#define XCFG_DATA      4 // xcfg_count bytes of bitstream follow
+#define XCFG_DONE      5 // bitstream complete or error, discard the rest
+#define XCFG_INIT      6 // waiting for INIT_B, see xcfg_init_poll()
+
+static unsigned char xcfg_state;
+static unsigned char xcfg_key;
+static unsigned char xcfg_left;
+static unsigned char xcfg_flags;
+static xdata unsigned long xcfg_count;
+static xdata unsigned long xcfg_total;
+static xdata unsigned short xcfg_start;
+
+//-----------------------------------------------------------------------------
+
+static unsigned char xcfg_ir(unsigned char ir, unsigned char end)
+{
+  /* Returns the IR capture */
+
+  return tap_shift(1, XCFG_IR_BITS, ir, end);
+}
+
+static void xcfg_stream(unsigned long len)
+{
+  xcfg_state = XCFG_DATA;
+  xcfg_count = len;
+
+  tap_scan_begin(0, len << 3, TAP_IDLE | TAP_MSB_FIRST);
+}
+
+void xcfg_begin(unsigned long len)
+{
+  xcfg_state = XCFG_INIT;
+  xcfg_total = len;
+  xcfg_flags = 0;
+
+  tap_goto(TAP_RESET);
+  xcfg_ir(XCFG_JPROGRAM, TAP_IDLE);
+
+  xcfg_start = sched_ticks();
+}
+
+unsigned char xcfg_init_poll(void)
+{
+  /* One look at INIT_B (with CFG_IN loaded) per call */
+
+  if(xcfg_state != XCFG_INIT) return 1;
+
+  if(xcfg_ir(XCFG_CFG_IN, TAP_IDLE) & XCFG_IR_INIT)
+  {
+    xcfg_state = XCFG_FIRST;
+    return 1;
+  };
+
+  if(sched_elapsed(xcfg_start) > XCFG_INIT_TICKS)
+  {
+    xcfg_flags = XCFG_ERR_INIT;
+    xcfg_state = XCFG_DONE;
+    return 1;
+  };
+
+  return 0;
+}
+
+static void xcfg_header(unsigned char d)
+{
+  switch(xcfg_state)
+  {
+    case XCFG_FIRST:
+      if(d == 0xFF)
+      {
+        xcfg_stream(xcfg_total);
+        tap_scan_byte(d);
+        if(--xcfg_count == 0) xcfg_state = XCFG_DONE;
+      }
+      else
+      {
+        xcfg_state = XCFG_SKIP;
+        xcfg_count = XCFG_BIT_PREAMBLE - 1;
+      };
+      break;
+
+    case XCFG_SKIP:
+      if(--xcfg_count == 0) xcfg_state = XCFG_KEY;
+      break;
+
+    case XCFG_KEY:
+      xcfg_key = d;
+      xcfg_left = (d == 'e') ? 4 : 2;
+      xcfg_count = 0;
+      xcfg_state = XCFG_LENGTH;
+      break;
+
+    case XCFG_LENGTH:
+      xcfg_count = (xcfg_count << 8) | d;
+      if(--xcfg_left > 0) break;
+
+      if(xcfg_key == 'e')
+        xcfg_stream(xcfg_count);
+      else if(xcfg_count > 0)
+        xcfg_state = XCFG_SKIP;
+      else
+        xcfg_state = XCFG_KEY;
+      break;
+
+    default:
+      break;
+  };
+}
+
+void xcfg_data(unsigned short n)
+{
+  /* n bytes at XAUTODAT1 */
+
+  while(n > 0)
+  {
+    if(xcfg_state == XCFG_DATA && xcfg_count > 0)
+    {
+      unsigned short k = (xcfg_count < n) ? xcfg_count : n;
+
+      n -= k;
+      xcfg_count -= k;
+      tap_scan_data(k);
+
+      if(xcfg_count == 0) xcfg_state = XCFG_DONE;
+    }
+    else
+    {
+      xcfg_header(XAUTODAT1);
+      n--;
+    };
+  };
+}
+
+void xcfg_end(void)
+{
+  /* Sends one byte: the IR capture ((DONE<<5)|(INIT_B<<4)|...|0x01)
+     plus XCFG_ERR_* flags. */
+
+  if(xcfg_state != XCFG_DONE) xcfg_flags |= XCFG_ERR_DATA;
+
+  if(xcfg_flags == 0)
+  {
+    xcfg_ir(XCFG_JSTART, TAP_IDLE);
+    tap_runtest_begin(TAP_IDLE, XCFG_START_CLOCKS);
+    while(!tap_runtest_poll());
+  }
+  else
+  {
+    tap_goto(TAP_RESET);
+  };
+
+  OutputByte(xcfg_flags | xcfg_ir(XCFG_BYPASS, TAP_RESET));
+}
+
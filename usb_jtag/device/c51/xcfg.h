@@ -0,0 +1,31 @@
+/*-----------------------------------------------------------------------------
+ * Xilinx FPGA configuration through JTAG
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _XCFG_H
+#define _XCFG_H 1
+
+/* Configure the selected device with len bytes of .bit or .bin file
+   passed to xcfg_data(), once xcfg_init_poll() has returned nonzero;
+   xcfg_end() sends the result byte */
+extern void xcfg_begin(unsigned long len);
+extern unsigned char xcfg_init_poll(void);
+extern void xcfg_data(unsigned short n);
+extern void xcfg_end(void);
+
+#endif /* _XCFG_H */
+
@@ -0,0 +1,76 @@
+/*-----------------------------------------------------------------------------
+ * Both JTAG chains of the Xilinx Platform Cable USB in one firmware
+ *-----------------------------------------------------------------------------
+ * Copyright (C) 2026 agent <agent@local>
+ *-----------------------------------------------------------------------------
+ * This code is part of usbjtag. usbjtag is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version. usbjtag is distributed in the hope
+ * that it will be useful, but WITHOUT ANY WARRANTY; without even the implied
+ * warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.  You should have received a
+ * copy of the GNU General Public License along with this program in the file
+ * COPYING; if not, write to the Free Software Foundation, Inc., 51 Franklin
+ * St, Fifth Floor, Boston, MA  02110-1301  USA
+ *-----------------------------------------------------------------------------
+ */
+
+#ifndef _XPCU_H
+#define _XPCU_H 1
+
+/* With HARDWARE=hw_xpcu, hw_xpcu_i.c (chain of the cable CPLD) and
+   hw_xpcu_x.c (target chain) are both linked. Each defines XPCU_PREFIX
+   and includes this file before hardware.h, so that its ProgIO functions
+   are named XpcuI_... and XpcuX_... instead; hw_xpcu.c passes the ProgIO
+   calls on to the chain selected with ProgIO_Set_Chain(). */
+
+#define XPCU_NAME(f)          XPCU_PASTE(XPCU_PREFIX,f)
+#define XPCU_PASTE(p,f)       XPCU_PASTE2(p,f)
+#define XPCU_PASTE2(p,f)      p##_##f
+
+#define XPCU_DECLARE(p) \
+  extern void p##_Init(void); \
+  extern unsigned char p##_Poll(void); \
+  extern void p##_Enable(void); \
+  extern void p##_Disable(void); \
+  extern void p##_Deinit(void); \
+  extern void p##_Set_State(unsigned char d); \
+  extern unsigned char p##_Set_Get_State(unsigned char d); \
+  extern unsigned char p##_Get_State(void); \
+  extern void p##_ShiftOut(unsigned char x); \
+  extern unsigned char p##_ShiftInOut(unsigned char x); \
+  extern void p##_ShiftOut_Block(unsigned char n); \
+  extern unsigned char p##_Vector(unsigned char v); \
+  extern void p##_Set_Sample_Point(unsigned char s); \
+  extern unsigned char p##_Set_Adaptive(unsigned char t)
+
+#ifdef XPCU_PREFIX
+
+#define ProgIO_Init               XPCU_NAME(Init)
+#define ProgIO_Poll               XPCU_NAME(Poll)
+#define ProgIO_Enable             XPCU_NAME(Enable)
+#define ProgIO_Disable            XPCU_NAME(Disable)
+#define ProgIO_Deinit             XPCU_NAME(Deinit)
+#define ProgIO_Set_State          XPCU_NAME(Set_State)
+#define ProgIO_Set_Get_State      XPCU_NAME(Set_Get_State)
+#define ProgIO_Get_State          XPCU_NAME(Get_State)
+#define ProgIO_ShiftOut           XPCU_NAME(ShiftOut)
+#define ProgIO_ShiftInOut         XPCU_NAME(ShiftInOut)
+#define ProgIO_ShiftOut_Block     XPCU_NAME(ShiftOut_Block)
+#define ProgIO_Vector             XPCU_NAME(Vector)
+#define ProgIO_Set_Sample_Point   XPCU_NAME(Set_Sample_Point)
+#define ProgIO_Set_Adaptive       XPCU_NAME(Set_Adaptive)
+
+#else
+
+/* Chains as numbered for ProgIO_Set_Chain() */
+#define XPCU_CHAIN_X  0  /* target (default) */
+#define XPCU_CHAIN_I  1  /* cable CPLD */
+
+XPCU_DECLARE(XpcuI);
+XPCU_DECLARE(XpcuX);
+
+#endif /* XPCU_PREFIX */
+
+#endif /* _XPCU_H */
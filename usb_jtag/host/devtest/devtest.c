@@ -85,7 +85,29 @@ int jtag_test(void)
 
 int asmi_test(void)
 {
-  printf("=== ASMI test ===\n  not implemented yet\n");
+  int i, n, got;
+  unsigned char buf[16];
+
+  /* Extended command 0x02: read 16 bytes from EPCS at address 0, then
+   * release nCONFIG (and nCE) in bit banging mode */
+
+  unsigned char cmd[] = { 0x80, 0x02, 0x00, 0x00, 0x00, 16, 0x00, 0x2A };
+
+  printf("=== ASMI test ===\n");
+
+  n = ftdi_write_data(&fc, cmd, sizeof(cmd));
+  if(n < 0) return dev_error("ftdi_write_data(read EPCS) failed");
+
+  for(got=0,i=0; got<16 && i<100; i++)
+  {
+    n = ftdi_read_data(&fc, buf+got, 16-got);
+    if(n < 0) return dev_error("ftdi_read_data failed");
+    got += n;
+  };
+
+  printf("  EPCS 0x000000:");
+  for(i=0;i<got;i++) { printf(" %02X", buf[i]); }; printf("\n");
+
   return 0;
 }
 